@@ -0,0 +1,33 @@
+# generates a header with the sources of all kernels as null terminated char arrays
+# so the library does not depend on the kernels directory at runtime
+# usage: cmake -DKERNEL_DIR=<kernels dir> -DOUTPUT=<header> -P embed_kernels.cmake
+
+file(GLOB KERNEL_FILES "${KERNEL_DIR}/*.cl")
+# 32 bytes per line (cmake regex has no repeat count)
+string(REPEAT "0x..," 32 LINE_PATTERN)
+list(SORT KERNEL_FILES)
+
+set(CONTENT "// generated from the kernels directory by cmake/embed_kernels.cmake, do not edit\n\n")
+string(APPEND CONTENT "#ifndef __KERNEL_SOURCES_GEN_H\n#define __KERNEL_SOURCES_GEN_H\n\n")
+set(ENTRIES "")
+foreach(KERNEL_FILE ${KERNEL_FILES})
+    get_filename_component(KERNEL_NAME ${KERNEL_FILE} NAME)
+    string(MAKE_C_IDENTIFIER ${KERNEL_NAME} KERNEL_VAR)
+    # hex bytes so the sources need no escaping
+    file(READ ${KERNEL_FILE} KERNEL_HEX HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," KERNEL_HEX "${KERNEL_HEX}")
+    string(REGEX REPLACE "(${LINE_PATTERN})" "\\1\n" KERNEL_HEX "${KERNEL_HEX}")
+    string(APPEND CONTENT "static const char ${KERNEL_VAR}[] = {\n${KERNEL_HEX}0x00};\n\n")
+    string(APPEND ENTRIES "    {\"${KERNEL_NAME}\", ${KERNEL_VAR}},\n")
+endforeach()
+
+string(APPEND CONTENT "static const EmbeddedKernelSource embedded_kernel_sources[] = {\n${ENTRIES}    {0, 0}};\n\n")
+string(APPEND CONTENT "#endif // __KERNEL_SOURCES_GEN_H\n")
+
+# only touch the header when a kernel changed so dependent files are not rebuilt
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} OLD_CONTENT)
+endif()
+if(NOT "${OLD_CONTENT}" STREQUAL "${CONTENT}")
+    file(WRITE ${OUTPUT} "${CONTENT}")
+endif()
@@ -0,0 +1,63 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __BUFFER_POOL_H
+#define __BUFFER_POOL_H
+
+#include <stddef.h>
+#include <CL/opencl.h>
+
+// pooled device buffers reused across calls instead of creating and releasing them every time
+// sizes are rounded up to size classes (quarter steps between powers of 2, so at most 25% is wasted)
+// all buffers are CL_MEM_READ_WRITE so any released buffer of the class can be reused
+typedef struct BufferPoolStats
+{
+	size_t allocations;	 // buffers created
+	size_t reuses;		 // acquires served by an idle buffer
+	size_t releases;	 // buffers released to opencl by the trim policy
+	size_t bytes_in_use; // acquired and not released yet
+	size_t bytes_idle;	 // kept in the pool for reuse
+	size_t high_water;	 // peak of in use + idle bytes
+} BufferPoolStats;
+
+// returns a buffer of at least size bytes for the context, exits if it can not be created
+cl_mem buffer_pool_acquire(cl_context context, size_t size);
+
+// returns the buffer to the pool, the commands using it must be complete
+// idle buffers above the limit are released oldest first
+void buffer_pool_release(cl_mem buffer);
+
+// max idle bytes kept in the pool (high water mark of the idle buffers), defaults to 256MB
+void buffer_pool_set_limit(size_t max_idle_bytes);
+
+// releases the idle buffers, oldest first, until no more than max_idle_bytes are kept
+void buffer_pool_trim(size_t max_idle_bytes);
+
+void buffer_pool_get_stats(BufferPoolStats *stats);
+void buffer_pool_print_stats();
+
+// releases all idle buffers, needs to be called before the context is released
+void buffer_pool_close();
+
+#endif // __BUFFER_POOL_H
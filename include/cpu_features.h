@@ -0,0 +1,42 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __CPU_FEATURES_H
+#define __CPU_FEATURES_H
+
+// simd levels for the host code, each level implies the previous ones
+#define SIMD_NONE 0
+#define SIMD_SSE42 1
+#define SIMD_AVX2 2	  // avx2 + fma
+#define SIMD_AVX512 3 // avx512f
+
+// highest simd level supported by the cpu and the os (detected once with cpuid)
+int get_cpu_simd_level();
+// highest simd level the host code will use, capped by set_max_simd_level()
+int get_simd_level();
+// cap the simd level ie: to compare against the scalar code
+void set_max_simd_level(int level);
+const char *simd_level_name(int level);
+
+#endif // __CPU_FEATURES_H
@@ -0,0 +1,61 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __KERNEL_CACHE_H
+#define __KERNEL_CACHE_H
+
+#include <CL/opencl.h>
+
+// built programs cached for the lifetime of the opencl context
+// keyed by context, device, kernel file and the defines prepended to the source (ie: tiling params)
+// note: cached kernels are shared, their args must not be set from multiple threads at the same time
+void kernel_cache_close();
+
+// returns the kernel built with the defines (can be NULL), the program is built on the first call
+// calls for a program that is being built on the warm up thread wait for it
+cl_kernel kernel_cache_get(cl_context context, cl_device_id device_id,
+						   const char *kernel_file, const char *kernel_name, const char *defines);
+
+// builds the kernel without adding the program to the cache or saving its binary (ie: tuning candidates)
+// a saved binary is still loaded, returns NULL on failure, otherwise the caller releases the kernel and the program
+cl_kernel kernel_cache_build(cl_context context, cl_device_id device_id, const char *kernel_file,
+							 const char *kernel_name, const char *defines, cl_program *program);
+
+// builds the programs on a background thread so later calls find them in the cache
+// the arrays are copied, defines can be NULL or contain NULL entries
+void kernel_cache_warmup(cl_context context, cl_device_id device_id, int count,
+						 const char **kernel_files, const char **kernel_names, const char **defines);
+
+// number of programs built since the cache was created, for checking cache hits
+int kernel_cache_builds();
+
+// number of the built programs that were loaded from the binary cache instead of compiled
+int kernel_cache_binary_loads();
+
+// directory for the compiled program binaries that are reused across runs, NULL disables it
+// defaults to MATMUL_KERNEL_CACHE_DIR if set (empty disables it), ~/.cache/matmul/kernels otherwise
+// (%LOCALAPPDATA%/matmul/kernels on windows), binaries are keyed by device, driver version and source
+void kernel_cache_set_dir(const char *dir);
+
+#endif // __KERNEL_CACHE_H
@@ -0,0 +1,42 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __KERNEL_SOURCES_H
+#define __KERNEL_SOURCES_H
+
+typedef struct EmbeddedKernelSource
+{
+	const char *name; // file name in the kernels directory
+	const char *source;
+} EmbeddedKernelSource;
+
+// read the kernels from this directory instead of the sources embedded at build time
+// ie: when working on the kernels without rebuilding, NULL uses the embedded sources
+void set_kernel_source_dir(const char *dir);
+
+// returns a copy of the kernel source that needs to be freed, NULL if the kernel is not found
+// kernels that are not embedded are read from kernel_file as a path
+char *get_kernel_source(const char *kernel_file);
+
+#endif // __KERNEL_SOURCES_H
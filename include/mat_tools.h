@@ -25,6 +25,8 @@ SOFTWARE.
 #ifndef __MAT_TOOLS_H
 #define __MAT_TOOLS_H
 #include <time.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include <stdbool.h>
 
@@ -33,6 +35,13 @@ SOFTWARE.
 #define DISPLAY_INT false
 #define MAX_DISPLAY_LEN 8
 
+// storage types of the matrices, the products are always accumulated in float
+#define MatFloat32 0
+#define MatFloat16 1  // IEEE half
+#define MatBFloat16 2 // bfloat16, the upper 16 bits of a float
+// alignment for host buffers used by simd code (cache line)
+#define MEM_ALIGNMENT 64
+
 typedef struct TileParams
 {
     int BM;
@@ -40,6 +49,9 @@ typedef struct TileParams
     int BK;
     int WIM;
     int WIN;
+    int VEC; // vector width of the global loads and stores of the tiling kernels (1 for scalar)
+    int DBUF; // 1 to double buffer the local tiles and load the next tile during the compute
+    int LPAD; // padding of the rows of the local tiles against bank conflicts (0 for none)
 } TileParams;
 
 typedef struct MatMultDims
@@ -53,17 +65,29 @@ typedef struct MatTransposeDims
 {
     int m;
     int n;
-    int tm; // transposed m
-    int tn; // transposed n
+    int tm; // transposed m (rows of the output, padded size of n)
+    int tn; // transposed n (cols of the output, padded size of m)
 } MatTransposeDims;
 
 float *create(int sizeA, int sizeB, float val);
+void *aligned_malloc(size_t size);
+void aligned_free(void *mem);
 void transpose(MatTransposeDims dims, float *mat, float *mat2);
+void transpose_inplace(int n, float *mat);
 void copy_mat(int sizeA1, int sizeB1, float *mat1, int sizeA2, int sizeB2, float *mat2, int lengthA, int lengthB);
 void assert_mat_equal(int sizeA, int sizeB, float *mat1, float *mat2);
+void assert_mat_near(int sizeA, int sizeB, float *mat1, float *mat2, float tolerance);
 void print_matrix(const char *header, float *m, int rows, int cols);
+bool is_valid_tiling(TileParams tile_params, int max_local_size);
 void validate_tiling(TileParams tile_params, int max_local_size);
 void set_default_tiling_params(TileParams *tile_params);
 void set_pref_tiling_params(MatMultDims dims, long max_local_size, TileParams *tile_params);
 time_t gettime();
+size_t dtype_size(int dtype);
+uint16_t float_to_half(float val);
+float half_to_float(uint16_t val);
+uint16_t float_to_bf16(float val);
+float bf16_to_float(uint16_t val);
+void convert_to_dtype(const float *src, void *dst, size_t count, int dtype);
+void convert_from_dtype(const void *src, float *dst, size_t count, int dtype);
 #endif // __MAT_TOOLS_H
\ No newline at end of file
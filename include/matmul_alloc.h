@@ -0,0 +1,56 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __MATMUL_ALLOC_H
+#define __MATMUL_ALLOC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MATMUL_ALLOC_HOST 0		  // aligned host memory, wrapped with CL_MEM_USE_HOST_PTR on host unified devices
+#define MATMUL_ALLOC_SVM_COARSE 1 // coarse grained svm, mapped for the host except while a kernel uses it
+#define MATMUL_ALLOC_SVM_FINE 2	  // fine grained svm, shared by the host and the device
+
+typedef struct MatMulAlloc
+{
+	void *ptr;
+	size_t size;
+	int type;
+	bool mapped; // coarse grained svm only
+	struct MatMulAlloc *next;
+} MatMulAlloc;
+
+// memory for matrices that the device can use without copies, needs init_opencl()
+// svm if the device supports it (fine grained preferred), aligned host memory otherwise
+// needs to be freed with matmul_free() before close_opencl()
+void *matmul_alloc(size_t size);
+void matmul_free(void *ptr);
+
+// allocation that contains the range, NULL if it is not from matmul_alloc
+MatMulAlloc *matmul_find_alloc(const void *ptr, size_t size);
+// coarse grained svm is handed to the device by unmapping it and back to the host by mapping it
+void matmul_alloc_unmap(MatMulAlloc *alloc);
+void matmul_alloc_map(MatMulAlloc *alloc);
+
+#endif // __MATMUL_ALLOC_H
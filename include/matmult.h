@@ -33,4 +33,9 @@ void multSwapLoops(int M, int K, int N, float* a, float* b, float* c);
 // convert second matrix to rowmajor by transposing
 void multRowMajor(int M, int K, int N, float* a, float* b, float* c);
 
+// cache blocked with packed panels of a and b (GotoBLAS style)
+void multBlocked(int M, int K, int N, float* a, float* b, float* c);
+// same on sub matrices, lda/ldb/ldc are the row strides
+void multBlockedStrided(int M, int K, int N, float* a, int lda, float* b, int ldb, float* c, int ldc);
+
 #endif // __MATMULT_H
\ No newline at end of file
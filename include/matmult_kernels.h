@@ -0,0 +1,64 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __MATMULT_KERNELS_H
+#define __MATMULT_KERNELS_H
+
+// largest register tile of all micro kernels
+#define GEMM_MAX_MR 12
+#define GEMM_MAX_NR 32
+
+// c[mr*nr] += ap[mr sliver] * bp[nr sliver] for a full register tile
+// ap holds kc columns of mr elements, bp holds kc rows of nr elements
+typedef void (*GemmKernelFunc)(int kc, const float *ap, const float *bp, float *c, int ldc);
+
+typedef struct GemmMicroKernel
+{
+	const char *name;
+	int mr; // register tile rows
+	int nr; // register tile cols
+	int mc; // rows of the packed block of a (multiple of mr)
+	int kc; // depth of the packed panels
+	int nc; // cols of the packed panel of b (multiple of nr)
+	GemmKernelFunc kernel;
+} GemmMicroKernel;
+
+// best micro kernel for the simd level, see cpu_features.h
+const GemmMicroKernel *get_gemm_micro_kernel(int simd_level);
+
+// dst[size*size] = transpose(src[size*size]) for one in-register tile
+// lds/ldd are the row strides of src and dst
+typedef void (*TransposeKernelFunc)(const float *src, int lds, float *dst, int ldd);
+
+typedef struct TransposeKernel
+{
+	const char *name;
+	int size; // tile size
+	TransposeKernelFunc kernel;
+} TransposeKernel;
+
+// best in-register transpose for the simd level, NULL if there is none (scalar)
+const TransposeKernel *get_transpose_kernel(int simd_level);
+
+#endif // __MATMULT_KERNELS_H
@@ -34,10 +34,145 @@ void close_opencl();
 #define MatMultTiling 1
 #define MatMultTilingColMaj 2
 #define MatMultTilingColMajPadded 3
+#define MatMultHostBlocked 4
+#define MatMultStrassen 5
+#define MatMultStreaming 6
+#define MatMultMultiDevice 7
+#define MatMultAuto 8
+
+// BLAS compatible sgemm (same values as CBLAS)
+typedef enum MatOrder
+{
+    MatRowMajor = 101,
+    MatColMajor = 102
+} MatOrder;
+
+typedef enum MatTranspose
+{
+    MatNoTrans = 111,
+    MatTrans = 112
+} MatTranspose;
 
 void openclMatMult(MatMultDims dims, float *a, float *b, float *c, int mult_type);
 void openclMatMultSimple(MatMultDims dims, float *a, float *b, float *c);
 void openclMatMultBlock(MatMultDims dims, float *A, float *B, float *c);
+// with use_inplace_transpose and no device transpose (use_cl_transpose), a square A is transposed in place
+// for the duration of the mult and restored before it returns, A must not be used concurrently
 void openclMatMultTilingColMajor(MatMultDims dims, float *A, float *B, float *c);
 void openclMatMultTilingColMajorPadded(MatMultDims dims, float *a, float *b, float *c);
+void hostMatMultBlocked(MatMultDims dims, float *a, float *b, float *c);
+void openclMatMultStrassen(MatMultDims dims, float *a, float *b, float *c);
+// for matrices larger than the device memory: row panels of a and c and column panels of b sized to
+// streaming_mem_budget are double buffered so the transfers overlap with the kernels
+void openclMatMultStreaming(MatMultDims dims, float *a, float *b, float *c);
+// rows split over the devices (use_multi_device) or sub devices (use_sub_devices) set before init_opencl
+// each device takes panels of rows in proportion to its measured throughput until all rows are done
+void openclMatMultMultiDevice(MatMultDims dims, float *a, float *b, float *c);
+
+// C = alpha * op(A) * op(B) + beta * C, op(A) is M*K, op(B) is K*N, C is M*N
+// lda, ldb, ldc are the leading dimensions so sub matrices can be passed directly
+// strided and transposed operands are read by the kernel, no host copies are made
+void sgemm(MatOrder order, MatTranspose transA, MatTranspose transB, int M, int N, int K,
+           float alpha, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+// batch of sgemm in a single launch, the matrices of batch i are at A + i * strideA, B + i * strideB, C + i * strideC
+// strideA and strideB can be 0 to use the same matrix for all batches
+void sgemmStridedBatched(MatOrder order, MatTranspose transA, MatTranspose transB, int M, int N, int K,
+                         float alpha, const float *A, int lda, long long strideA, const float *B, int ldb, long long strideB,
+                         float beta, float *C, int ldc, long long strideC, int batch);
+// batch of row major c = a * b with the same dims, uploaded, multiplied and read back at once
+void openclMatMultStridedBatched(MatMultDims dims, int batch,
+                                 float *a, long long strideA, float *b, long long strideB, float *c, long long strideC);
+// group of row major c = a * b with different dims in a single launch
+// the matrices of problem i are at a + offsetsA[i], b + offsetsB[i], c + offsetsC[i]
+void openclMatMultGrouped(int count, MatMultDims *dims,
+                          float *a, size_t *offsetsA, float *b, size_t *offsetsB, float *c, size_t *offsetsC);
+
+// async row major c = a * b (mult_type MatMultSimple or MatMultTiling), returns once the work is enqueued
+// the writes wait for the wait_list events (can be NULL), a and b must not change until the handle completes
+// c is only written when the handle is waited on
+typedef struct MatMultHandle MatMultHandle;
+// called on an opencl thread when the kernel completes, must not wait on the handle
+typedef void (*MatMultCallback)(MatMultHandle *handle, void *user_data);
+MatMultHandle *openclMatMultAsync(MatMultDims dims, float *a, float *b, float *c, int mult_type,
+                                  int num_events, const cl_event *wait_list);
+// blocks until the kernel completes and reads c back
+int openclMatMultWait(MatMultHandle *handle);
+// true if the kernel completed so the wait does not block on the device
+bool openclMatMultTest(MatMultHandle *handle);
+void openclMatMultSetCallback(MatMultHandle *handle, MatMultCallback callback, void *user_data);
+// kernel event to chain other work after the mult, valid until the handle is released
+cl_event openclMatMultGetEvent(MatMultHandle *handle);
+// waits if needed and frees the handle
+void openclMatMultRelease(MatMultHandle *handle);
+
+// row major matrices kept on the device so results can be multiplied again without host round trips
+// handles are immutable, derived forms (transposed or padded for the col major kernels) are built once and kept
+typedef struct MatHandle MatHandle;
+MatHandle *matHandleUpload(int rows, int cols, const float *data);
+void matHandleDownload(MatHandle *handle, float *data);
+int matHandleRows(MatHandle *handle);
+int matHandleCols(MatHandle *handle);
+void matHandleRelease(MatHandle *handle);
+// new handle with a * b, mult_type MatMultSimple, MatMultTiling, MatMultTilingColMaj or MatMultTilingColMajPadded
+MatHandle *openclMatMultHandle(MatHandle *a, MatHandle *b, int mult_type);
+
+// fixed operand (ie: weights) uploaded once and packed into the layout the mult_type kernel reads
+// (a transposed and padded to the blocks, b padded), later mults skip the transpose and padding for it
+#define MatOperandA 0
+#define MatOperandB 1
+MatHandle *matHandlePack(int rows, int cols, const float *data, int operand, int mult_type);
+// c = a * b with the packed a (m * k) and the host b (k * n)
+void openclMatMultPackedA(MatHandle *a, int n, float *b, float *c, int mult_type);
+// c = a * b with the host a (m * k) and the packed b (k * n)
+void openclMatMultPackedB(int m, float *a, MatHandle *b, float *c, int mult_type);
+
+// mult of matrices stored as dtype (MatFloat32, MatFloat16 or MatBFloat16 from mat_tools.h), the 16 bit types
+// halve the transfers and the kernels accumulate in float, see convert_to_dtype and convert_from_dtype
+// supports MatMultSimple, MatMultTiling, MatMultTilingColMaj and MatMultTilingColMajPadded
+// the tiled kernels use the tiling params tuned for float, the local tiles are float for all dtypes
+void openclMatMultDType(MatMultDims dims, void *a, void *b, void *c, int mult_type, int dtype);
+
+// int8 mult with int32 accumulation, a (m * k) and b (k * n) are row major int8 with zero points,
+// c is int32 (MatQuantInt32), float scaled by the row scales of a and the column scales of b (MatQuantFloat)
+// or int8 requantized with the scale and zero point of c (MatQuantInt8)
+#define MatQuantInt32 0
+#define MatQuantFloat 1
+#define MatQuantInt8 2
+typedef struct MatQuantParams
+{
+    int a_zero;
+    int b_zero;
+    const float *a_scales;  // per row of a (m), NULL for 1
+    const float *b_scales;  // per column of b (n), NULL for 1
+    float c_scale;          // MatQuantInt8 only
+    int c_zero;             // MatQuantInt8 only
+} MatQuantParams;
+void openclMatMultInt8(MatMultDims dims, const int8_t *a, const int8_t *b, void *c, MatQuantParams *params, int out_type);
+
+// times the legal tilings of the kernel of mult_type (MatMultTiling, MatMultTilingColMaj or MatMultTilingColMajPadded)
+// on dims and stores the fastest in the tuning db, later mults of the same device, kernel and shape bucket use it
+TileParams openclTuneTiling(int mult_type, MatMultDims dims);
+
+// GFLOPS of the kernel of mult_type on dims for each of the count tilings, the kernel time only without transfers,
+// negative if the tiling is not valid for the device or the dims, the operands are created once for all tilings
+void openclBenchTiling(int mult_type, MatMultDims dims, int count, const TileParams *tile_params, double *gflops);
+
+// cost model planner of MatMultAuto, estimates the transfers, the transpose and padding and the kernel time
+// of the simple, tiling, col major and padded mults and of the host blocked mult (mult types 0 to 4)
+#define MatMultPlanTypes 5
+typedef struct MatMultPlan
+{
+    int mult_type;                      // the cheapest
+    double transfer_secs;               // call overhead and transfers of the copied operands of the simple mult
+    double costs[MatMultPlanTypes];     // estimated secs per mult type
+} MatMultPlan;
+// measures the call overhead, transfer and copy rates and the throughput and fixed cost of each mult type
+// fitted over two calibration sizes, runs on the first planned mult, call again to recalibrate (ie: after tuning)
+void openclMatMultCalibrate();
+// the cheapest mult type for dims, plan (can be NULL) gets the estimates for logging
+// only the operands that are copied are charged, zero copy operands (see use_zero_copy) move nothing,
+// a, b and c can be NULL to plan for copied operands
+int openclMatMultPlan(MatMultDims dims, const float *a, const float *b, const float *c, MatMultPlan *plan);
+// mult with the planned mult type, also mult_type MatMultAuto
+void openclMatMultAuto(MatMultDims dims, float *a, float *b, float *c);
 #endif // __OPENCL_MATMULT_H
\ No newline at end of file
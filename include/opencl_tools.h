@@ -32,6 +32,7 @@ SOFTWARE.
 #define MAX_DEVICES 8
 #define MAX_CHARS 1024
 #define MAX_SOURCE_SIZE (0x100000)
+#define MAX_DEFINES_SIZE (4 * 1024)
 
 void displayDevice(cl_device_id device_id);
 void displayDevices(cl_platform_id cpPlatform);
@@ -40,8 +41,26 @@ void initPlatforms();
 int getWorkgroupSize(cl_kernel kernel, cl_device_id device_id);
 int getMaxLocalSize(cl_kernel kernel, cl_device_id device_id, int dims);
 long getMaxSharedMemSize();
+size_t getGlobalMemSize(cl_device_id device_id);
+size_t getMaxMemAllocSize(cl_device_id device_id);
+bool getHostUnifiedMemory(cl_device_id device_id);
+cl_device_svm_capabilities getSvmCapabilities(cl_device_id device_id);
+// in bytes
+int getMemBaseAddrAlign(cl_device_id device_id);
+void get_kernel_defines(char *defines_str, TileParams tile_params);
 void add_kernel_defines(char *source_str, TileParams tile_params);
+void get_dtype_defines(char *defines_str, int dtype);
+void add_kernel_source_defines(char *source_str, const char *defines);
 void add_kernel_transpose_defines(char *source_str, int TRANSPOSEX, int TRANSPOSEY);
-int get_kernel_max_local_size(cl_context context, char *source_str, char *kernel_name, cl_device_id device_id, TileParams tile_params);
+int get_kernel_max_local_size(cl_context context, char *kernel_file, char *kernel_name, cl_device_id device_id, TileParams tile_params);
+void printBuildError(cl_device_id device_id, cl_program program);
+
+// files of the kernel binary cache and the tuning db
+char *copy_str(const char *str);
+// name under the user cache dir (~/.cache/matmul on linux, %LOCALAPPDATA%/matmul on windows), the env var
+// overrides the path and disables it if empty, NULL if disabled or there is no home
+char *get_cache_path(const char *env_name, const char *name);
+// creates the parent directories of the file
+void make_dirs(const char *file_path);
 
 #endif // __OPENCL_TOOLS_H
\ No newline at end of file
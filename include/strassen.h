@@ -0,0 +1,42 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __STRASSEN_H
+#define __STRASSEN_H
+
+#include <stddef.h>
+
+// leaf multiplication c = a * b (overwrites c), lda/ldb/ldc are the row strides
+typedef void (*StrassenLeafMult)(int M, int K, int N, float *a, int lda, float *b, int ldb, float *c, int ldc);
+
+// host leaf using the cache blocked mult
+void strassen_host_leaf(int M, int K, int N, float *a, int lda, float *b, int ldb, float *c, int ldc);
+
+// Strassen-Winograd (7 mults, 15 adds) c = a * b for row major a[M*K], b[K*N], c[M*N]
+// recurses while all dims are larger than cutoff and hands the smaller problems to leaf,
+// odd dims are peeled off at each level and fixed up with matrix-vector products
+// returns the peak extra memory used for temporaries in bytes
+size_t multStrassen(int M, int K, int N, float *a, float *b, float *c, int cutoff, StrassenLeafMult leaf);
+
+#endif // __STRASSEN_H
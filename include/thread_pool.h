@@ -0,0 +1,46 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <stdbool.h>
+
+// task callback, task is the task index and worker the index of the thread running it
+// worker indexes are in [0, thread_pool_size()) so they can be used to pick per thread scratch buffers
+typedef void (*ThreadPoolTask)(void *ctx, int task, int worker);
+
+// persistent pool with one deque per worker, idle workers steal tasks from the others
+// num_threads: total threads including the caller of thread_pool_run, 0 uses all cores
+// pin_threads: pin each worker thread to a core
+void thread_pool_init(int num_threads, bool pin_threads);
+void thread_pool_close();
+int thread_pool_size();
+int get_num_cores();
+
+// run tasks [0, num_tasks) on the pool and wait for all of them to finish
+// the pool is created with the defaults on first use, nested calls run serially
+void thread_pool_run(int num_tasks, ThreadPoolTask task, void *ctx);
+
+#endif // __THREAD_POOL_H
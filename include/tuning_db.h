@@ -0,0 +1,49 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __TUNING_DB_H
+#define __TUNING_DB_H
+
+#include <stdbool.h>
+#include "mat_tools.h"
+
+// tiling params measured by the autotuner, kept in a text file across runs
+// keyed by device name, kernel name and shape bucket (each dim rounded up to a power of two)
+
+// true and the stored params if the bucket of dims was tuned for the device and kernel
+bool tuning_db_lookup(const char *device_name, const char *kernel_name, MatMultDims dims, TileParams *tile_params);
+
+// stores the params for the bucket of dims and saves the file, replaces the entry of the bucket
+void tuning_db_store(const char *device_name, const char *kernel_name, MatMultDims dims,
+					 TileParams tile_params, double gflops);
+
+// file of the tuning db, NULL disables it
+// defaults to MATMUL_TUNING_FILE if set (empty disables it), ~/.cache/matmul/tuning.txt otherwise
+// (%LOCALAPPDATA%/matmul/tuning.txt on windows)
+void tuning_db_set_file(const char *path);
+
+// frees the loaded entries
+void tuning_db_close();
+
+#endif // __TUNING_DB_H
@@ -22,21 +22,23 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+// the storage type DTYPE, the accumulator type ACCTYPE and the LOAD/STORE conversions are defined by the host
+
 // simple
 // matrix a needs to be in row major format (M*K)
 // matrix b needs to be in row major format (K*N)
 // matrix c will be in row major format (M*N)
 __kernel void matmult_simple(const int M, const int K, const int N,
-                      const __global float* a,
-                      const __global float* b,
-                      __global float* c) {{
+                      const __global DTYPE* a,
+                      const __global DTYPE* b,
+                      __global DTYPE* c) {{
     const int row = get_global_id(0);
     const int col = get_global_id(1);
 	if(row >= M || col >= N)
 		return;
-    float C = 0.0f;
+    ACCTYPE C = 0.0f;
     for (int ik=0; ik<K; ik++) {{
-        C += a[row*K + ik] * b[ik*N + col];
+        C += LOAD(row*K + ik, a) * LOAD(ik*N + col, b);
     }}
-    c[row*N + col] = C;
+    STORE(C, row*N + col, c);
 }}
\ No newline at end of file
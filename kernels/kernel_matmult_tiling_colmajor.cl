@@ -22,6 +22,29 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+// the storage type DTYPE, the accumulator type ACCTYPE and the LOAD/STORE conversions are defined by the host
+
+// vector loads and stores of VEC floats
+#if VEC > 1
+#define CONCAT_(a, b) a##b
+#define CONCAT(a, b) CONCAT_(a, b)
+#define floatv CONCAT(float, VEC)
+#define vloadv CONCAT(vload, VEC)
+#define vstorev CONCAT(vstore, VEC)
+#endif
+
+// double buffered local tiles, the next tile is loaded while the current one is computed
+#if DBUF
+#define NBUF 2
+#else
+#define NBUF 1
+#endif
+
+// padding of the local tile rows, a stride of BM + LPAD spreads the columns over the memory banks
+#ifndef LPAD
+#define LPAD 0
+#endif
+
 // tiling with transposed matrix a for coalesced mem reads
 // matrix a needs to be transposed in col major format (K*M)
 // matrix b needs to be in row major format (K*N)
@@ -30,9 +53,9 @@ SOFTWARE.
 // block BB will be in row major format (BK*BN)
 // block BC will be in row major format (BM*BN)
 __kernel void matmult_block_colmajor(const int M, const int K, const int N,
-					const __global float* a,
-					const __global float* b,
-					__global float* c) {{
+					const __global DTYPE* a,
+					const __global DTYPE* b,
+					__global DTYPE* c) {{
 
     const int lclId0 = get_local_id(0);
     const int lclId1 = get_local_id(1);
@@ -50,8 +73,18 @@ __kernel void matmult_block_colmajor(const int M, const int K, const int N,
 	const int offsetB = witem*WIB_SIZE;
 	
 	// submatrices
-    __local float BA[BK][BM];
-	__local float BB[BK][BN];
+    __local float BA[NBUF][BK][BM + LPAD];
+	__local float BB[NBUF][BK][BN + LPAD];
+#if VEC > 1
+	floatv BC[WIM][WIN/VEC];
+	#pragma unroll
+    for (int row=0; row<WIM; row++) {{
+        #pragma unroll
+        for (int col=0; col<WIN/VEC; col++) {{
+            BC[row][col] = (floatv)(0.0f);
+        }}
+    }}
+#else
 	float BC[WIM][WIN];
 	#pragma unroll
     for (int row=0; row<WIM; row++) {{
@@ -60,52 +93,113 @@ __kernel void matmult_block_colmajor(const int M, const int K, const int N,
             BC[row][col] = 0.0f;
         }}
     }}
+#endif
 	
-    for(int tile=0; tile<tiles; tile++) {{
+	// with DBUF one more step computes the last tile after all tiles are loaded
+    for(int step=0; step<tiles + NBUF - 1; step++) {{
 		
-		int offseta = offsetm + BK*tile*M;
-		int row = offsetA / BM, col;
-		#pragma unroll
-		for(int idx=0; idx<WIA_SIZE; idx++) {{
-			col = (offsetA + idx) % BM;
-			if(idx>0 && col == 0) {{
-				row++;
+		const int tile = step;
+		const int lbuf = tile % NBUF;
+		if(tile < tiles) {{
+#if VEC > 1
+			int offseta = offsetm + BK*tile*M;
+			#pragma unroll
+			for(int idx=0; idx<WIA_SIZE; idx+=VEC) {{
+				const int row = (offsetA + idx) / BM;
+				const int col = (offsetA + idx) % BM;
+				const int ia = offseta + M*row + col;
+				if(ia >= K*M)
+					break;
+				if(ia + VEC <= K*M) {{
+					vstorev(LOADV(0, a + ia), 0, &BA[lbuf][row][col]);
+				}} else {{
+					// scalar tail at the end of a
+					for(int v=0; v<VEC; v++)
+						BA[lbuf][row][col + v] = ia + v < K*M ? LOAD(ia + v, a) : 0.0f;
+				}}
 			}}
-			if(offseta + M*row + col >= K*M)
-				break;
-			BA[row][col] = a[offseta + M*row + col];
-		}}
 		
-		int offsetb = offsetn + BK*tile*N;
-		row = offsetB / BN;
-		int offsetbb = offsetb + N*row;
-		#pragma unroll
-		for(int idx=0; idx<WIB_SIZE;idx++) {{
-			col = (offsetB + idx) % BN;
-			if(idx>0 && col == 0) {{ 
-				row++;
-				offsetbb = offsetb + N*row;
+			int offsetb = offsetn + BK*tile*N;
+			#pragma unroll
+			for(int idx=0; idx<WIB_SIZE; idx+=VEC) {{
+				const int row = (offsetB + idx) / BN;
+				const int col = (offsetB + idx) % BN;
+				const int ib = offsetb + N*row + col;
+				if(ib >= K*N)
+					break;
+				if(ib + VEC <= K*N) {{
+					vstorev(LOADV(0, b + ib), 0, &BB[lbuf][row][col]);
+				}} else {{
+					// scalar tail at the end of b
+					for(int v=0; v<VEC; v++)
+						BB[lbuf][row][col + v] = ib + v < K*N ? LOAD(ib + v, b) : 0.0f;
+				}}
 			}}
-			if(offsetbb + col >= K*N) {{
-				break;
+#else
+			int offseta = offsetm + BK*tile*M;
+			int row = offsetA / BM, col;
+			#pragma unroll
+			for(int idx=0; idx<WIA_SIZE; idx++) {{
+				col = (offsetA + idx) % BM;
+				if(idx>0 && col == 0) {{
+					row++;
+				}}
+				if(offseta + M*row + col >= K*M)
+					break;
+				BA[lbuf][row][col] = LOAD(offseta + M*row + col, a);
+			}}
+		
+			int offsetb = offsetn + BK*tile*N;
+			row = offsetB / BN;
+			int offsetbb = offsetb + N*row;
+			#pragma unroll
+			for(int idx=0; idx<WIB_SIZE;idx++) {{
+				col = (offsetB + idx) % BN;
+				if(idx>0 && col == 0) {{ 
+					row++;
+					offsetbb = offsetb + N*row;
+				}}
+				if(offsetbb + col >= K*N) {{
+					break;
+				}}
+				BB[lbuf][row][col] = LOAD(offsetbb + col, b);
 			}}
-			BB[row][col] = b[offsetbb + col];
+#endif
 		}}
 
+#if !DBUF
         barrier(CLK_LOCAL_MEM_FENCE);
+#endif
 
-		// partial writes
-		const int maxK = K - BK*tile < BK ? K - BK*tile : BK;
+		const int ctile = step - (NBUF - 1);
+		const int cbuf = ctile % NBUF;
+		if(ctile >= 0) {{
+			// partial writes
+			const int maxK = K - BK*ctile < BK ? K - BK*ctile : BK;
 		
-		for(int ik=0; ik<BK; ik++) {{
-			#pragma unroll
-			for(int row=0; row<WIM; row++) {{
-				#pragma unroll	
-				for(int col=0; col<WIN; col++) {{
-					if(ik < maxK)
-						BC[row][col] += BA[ik][row + WIM*lclId0] * BB[ik][col + WIN*lclId1];
+#if VEC > 1
+			for(int ik=0; ik<maxK; ik++) {{
+				#pragma unroll
+				for(int row=0; row<WIM; row++) {{
+					const float ba = BA[cbuf][ik][row + WIM*lclId0];
+					#pragma unroll	
+					for(int col=0; col<WIN/VEC; col++) {{
+						BC[row][col] += ba * vloadv(0, &BB[cbuf][ik][col*VEC + WIN*lclId1]);
+					}}
+				}}
+			}}
+#else
+			for(int ik=0; ik<BK; ik++) {{
+				#pragma unroll
+				for(int row=0; row<WIM; row++) {{
+					#pragma unroll	
+					for(int col=0; col<WIN; col++) {{
+						if(ik < maxK)
+							BC[row][col] += BA[cbuf][ik][row + WIM*lclId0] * BB[cbuf][ik][col + WIN*lclId1];
+					}}
 				}}
 			}}
+#endif
 		}}
 
         barrier(CLK_LOCAL_MEM_FENCE);
@@ -119,12 +213,33 @@ __kernel void matmult_block_colmajor(const int M, const int K, const int N,
 	if(cOffsetCol < N && cOffsetRow < M) {{
 		#pragma unroll
 		for(int row=0; row<WIM; row++) {{
+			// partial blocks at the bottom of c
+			if(cOffsetRow + row >= M)
+				break;
+#if VEC > 1
+			#pragma unroll
+			for(int col=0; col<WIN/VEC; col++) {{
+				const int colc = cOffsetCol + col*VEC;
+				if(colc >= N)
+					break;
+				if(colc + VEC <= N) {{
+					STOREV(BC[row][col], 0, c + idx + row*N + col*VEC);
+				}} else {{
+					// scalar tail at the right of c
+					float vc[VEC];
+					vstorev(BC[row][col], 0, vc);
+					for(int v=0; colc + v<N; v++)
+						STORE(vc[v], idx + row*N + col*VEC + v, c);
+				}}
+			}}
+#else
 			#pragma unroll
 			for(int col=0; col<WIN; col++) {{
 				if((idx + row*N) % N + col >= N)
 					continue;
-				c[idx + row*N + col] = BC[row][col];
+				STORE(BC[row][col], idx + row*N + col, c);
 			}}
+#endif
 		}}
 	}}
 }}
\ No newline at end of file
@@ -0,0 +1,163 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// output of the int32 accumulators, OUT_MODE 0: int32, 1: float with the scales, 2: requantized int8
+#ifndef OUT_MODE
+#define OUT_MODE 0
+#endif
+#if OUT_MODE == 1
+#define OUT_TYPE float
+#elif OUT_MODE == 2
+#define OUT_TYPE char
+#else
+#define OUT_TYPE int
+#endif
+
+// padding of the local tile rows against bank conflicts
+#ifndef LPAD
+#define LPAD 0
+#endif
+
+// dot product of 4 signed int8 packed in a uint
+// the extension only guarantees the 4x8 bit input forms the device reports with the feature macro
+inline int dot4(uint a, uint b) {{
+#if defined(cl_khr_integer_dot_product) && defined(__opencl_c_integer_dot_product_input_4x8bit_packed)
+	return dot_4x8packed_ss_int(a, b);
+#else
+	return ((int)(a << 24) >> 24) * ((int)(b << 24) >> 24) +
+		   ((int)(a << 16) >> 24) * ((int)(b << 16) >> 24) +
+		   ((int)(a << 8) >> 24) * ((int)(b << 8) >> 24) +
+		   ((int)a >> 24) * ((int)b >> 24);
+#endif
+}}
+
+// int8 tiling with int32 accumulation, each element is a uint of 4 int8 consecutive in k
+// so K and BK count the packed groups of 4
+// matrix a needs to be in row major format (M*K) packed along its rows
+// matrix b needs to be in row major format (K*N) packed along its columns, the 4 values of rows 4k..4k+3
+// matrix c will be in row major format (M*N)
+// block BA will be transposed in col major format (BK*BM)
+// block BB will be in row major format (BK*BN)
+// block BC will be in row major format (BM*BN)
+// zero points are applied in the epilogue with the row sums of a and the column sums of b:
+// sum((a - za) * (b - zb)) = sum(a * b) - zb * sum(a) - za * sum(b) + k * za * zb
+// Note: all matrices should be padded for dimensions to be multiples of M, N, K, the padding must be 0
+__kernel void matmult_block_int8(const int M, const int K, const int N, const int depth,
+					const __global uint* a,
+					const __global uint* b,
+					__global OUT_TYPE* c,
+					const __global int* rowsum_a,
+					const __global int* colsum_b,
+					const __global float* scales_a,
+					const __global float* scales_b,
+					const int zero_a, const int zero_b,
+					const float scale_c, const int zero_c) {{
+
+    const int lclId0 = get_local_id(0);
+    const int lclId1 = get_local_id(1);
+	
+	// offset
+    const int offsetm = BM*get_group_id(0);
+    const int offsetn = BN*get_group_id(1);
+    const int tiles = K/BK;
+	
+	// work item for the current work group
+	const int witem = lclId1*get_local_size(1) + lclId0;
+	
+	// offsets for sub matrices
+	const int offsetA = witem*WIA_SIZE;	
+	const int offsetB = witem*WIB_SIZE;
+	
+	// submatrices
+    __local uint BA[BK][BM + LPAD];
+	__local uint BB[BK][BN + LPAD];
+	int BC[WIM][WIN];
+	#pragma unroll
+    for (int row=0; row<WIM; row++) {{
+        #pragma unroll
+        for (int col=0; col<WIN; col++) {{
+            BC[row][col] = 0;
+        }}
+    }}
+	
+    for(int tile=0; tile<tiles; tile++) {{
+		
+		int offseta = offsetm*K + BK*tile;
+		#pragma unroll
+		for(int idx=0; idx<WIA_SIZE; idx++) {{
+			const int row = (offsetA + idx) / BK;
+			const int col = (offsetA + idx) % BK;
+			BA[col][row] = a[offseta + K*row + col];
+		}}
+		
+		int offsetb = offsetn + BK*tile*N;
+		#pragma unroll
+		for(int idx=0; idx<WIB_SIZE; idx++) {{
+			const int row = (offsetB + idx) / BN;
+			const int col = (offsetB + idx) % BN;
+			BB[row][col] = b[offsetb + N*row + col];
+		}}
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+		for(int ik=0; ik<BK; ik++) {{
+			#pragma unroll
+			for(int row=0; row<WIM; row++) {{
+				const uint ba = BA[ik][row + WIM*lclId0];
+				#pragma unroll	
+				for(int col=0; col<WIN; col++) {{
+					BC[row][col] += dot4(ba, BB[ik][col + WIN*lclId1]);
+				}}
+			}}
+		}}
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }}
+
+    const int cOffsetRow = offsetm + WIM*lclId0;
+	const int cOffsetCol = offsetn + WIN*lclId1;
+	
+	// depth is the unpadded k in int8 values
+	const int zero_ab = depth*zero_a*zero_b;
+	#pragma unroll
+	for(int row=0; row<WIM; row++) {{
+		const int m = cOffsetRow + row;
+		const int zero_row = zero_b*rowsum_a[m];
+		#pragma unroll
+		for(int col=0; col<WIN; col++) {{
+			const int n = cOffsetCol + col;
+			const int acc = BC[row][col] - zero_row - zero_a*colsum_b[n] + zero_ab;
+#if OUT_MODE == 0
+			c[m*N + n] = acc;
+#else
+			const float val = acc*scales_a[m]*scales_b[n];
+#if OUT_MODE == 1
+			c[m*N + n] = val;
+#else
+			c[m*N + n] = (char)clamp((int)rint(val/scale_c) + zero_c, -128, 127);
+#endif
+#endif
+		}}
+	}}
+}}
@@ -0,0 +1,200 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// BLAS style tiling: c = alpha * op(a) * op(b) + beta * c
+// all matrices are row major with leading dimensions (row strides) lda, ldb, ldc
+// TRANSA: a is stored transposed (K*M), otherwise (M*K)
+// TRANSB: b is stored transposed (N*K), otherwise (K*N)
+// tiles are loaded along the contiguous dimension of each operand for coalesced reads
+// and zero filled outside of the matrices so the inner loop has no branches
+// block BA will be transposed in col major format (BK*BM)
+// block BB will be in row major format (BK*BN)
+// block BC will be in row major format (BM*BN)
+// computes the block of c at offsetm, offsetn, BA and BB are the local blocks of the calling kernel
+void sgemm_tile(const int M, const int N, const int K,
+					const float alpha,
+					const __global float* a, const int lda,
+					const __global float* b, const int ldb,
+					const float beta,
+					__global float* c, const int ldc,
+					const int offsetm, const int offsetn,
+					__local float (*BA)[BM], __local float (*BB)[BN]) {{
+
+    const int lclId0 = get_local_id(0);
+    const int lclId1 = get_local_id(1);
+
+    const int tiles = (K + BK - 1)/BK;
+
+	// work item for the current work group
+	const int witem = lclId1*get_local_size(0) + lclId0;
+
+	// offsets for sub matrices
+	const int offsetA = witem*WIA_SIZE;
+	const int offsetB = witem*WIB_SIZE;
+
+	// submatrices
+	float BC[WIM][WIN];
+	#pragma unroll
+    for (int row=0; row<WIM; row++) {{
+        #pragma unroll
+        for (int col=0; col<WIN; col++) {{
+            BC[row][col] = 0.0f;
+        }}
+    }}
+
+    for(int tile=0; tile<tiles; tile++) {{
+		const int offsetk = BK*tile;
+
+		#pragma unroll
+		for(int idx=0; idx<WIA_SIZE; idx++) {{
+#ifdef TRANSA
+			const int ik = (offsetA + idx) / BM;
+			const int im = (offsetA + idx) % BM;
+			const int gm = offsetm + im, gk = offsetk + ik;
+			BA[ik][im] = (gm < M && gk < K) ? a[gk*lda + gm] : 0.0f;
+#else
+			const int im = (offsetA + idx) / BK;
+			const int ik = (offsetA + idx) % BK;
+			const int gm = offsetm + im, gk = offsetk + ik;
+			BA[ik][im] = (gm < M && gk < K) ? a[gm*lda + gk] : 0.0f;
+#endif
+		}}
+
+		#pragma unroll
+		for(int idx=0; idx<WIB_SIZE; idx++) {{
+#ifdef TRANSB
+			const int in = (offsetB + idx) / BK;
+			const int ik = (offsetB + idx) % BK;
+			const int gn = offsetn + in, gk = offsetk + ik;
+			BB[ik][in] = (gn < N && gk < K) ? b[gn*ldb + gk] : 0.0f;
+#else
+			const int ik = (offsetB + idx) / BN;
+			const int in = (offsetB + idx) % BN;
+			const int gn = offsetn + in, gk = offsetk + ik;
+			BB[ik][in] = (gn < N && gk < K) ? b[gk*ldb + gn] : 0.0f;
+#endif
+		}}
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+		for(int ik=0; ik<BK; ik++) {{
+			#pragma unroll
+			for(int row=0; row<WIM; row++) {{
+				#pragma unroll
+				for(int col=0; col<WIN; col++) {{
+					BC[row][col] += BA[ik][row + WIM*lclId0] * BB[ik][col + WIN*lclId1];
+				}}
+			}}
+		}}
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }}
+
+    const int cOffsetRow = offsetm + WIM*lclId0;
+	const int cOffsetCol = offsetn + WIN*lclId1;
+
+	#pragma unroll
+	for(int row=0; row<WIM; row++) {{
+		if(cOffsetRow + row >= M)
+			break;
+		#pragma unroll
+		for(int col=0; col<WIN; col++) {{
+			if(cOffsetCol + col >= N)
+				break;
+			const int idx = (cOffsetRow + row)*ldc + cOffsetCol + col;
+			// beta == 0 does not read c so it can be uninitialized (BLAS semantics)
+			c[idx] = beta == 0.0f ? alpha * BC[row][col] : alpha * BC[row][col] + beta * c[idx];
+		}}
+	}}
+}}
+
+
+// dim 2 of the NDRange is the batch, matrices of each batch are strideA, strideB, strideC apart
+// a stride of 0 reuses the same matrix for all batches
+__kernel void sgemm_block(const int M, const int N, const int K,
+					const float alpha,
+					const __global float* a, const int lda, const long strideA,
+					const __global float* b, const int ldb, const long strideB,
+					const float beta,
+					__global float* c, const int ldc, const long strideC) {{
+
+	const long batch = get_group_id(2);
+
+	__local float BA[BK][BM];
+	__local float BB[BK][BN];
+
+	sgemm_tile(M, N, K, alpha,
+		a + batch*strideA, lda,
+		b + batch*strideB, ldb,
+		beta,
+		c + batch*strideC, ldc,
+		BM*get_group_id(0), BN*get_group_id(1),
+		BA, BB);
+}}
+
+// grouped gemm: problems with different dims in a single launch, c = a * b for each problem
+// desc is a table of GROUP_DESC_SIZE ints per problem, sorted by the first tile of each problem
+// each work group in dim 0 is one BM*BN tile of one of the problems
+#define GROUP_M 0
+#define GROUP_N 1
+#define GROUP_K 2
+#define GROUP_OFFSET_A 3
+#define GROUP_OFFSET_B 4
+#define GROUP_OFFSET_C 5
+#define GROUP_FIRST_TILE 6
+#define GROUP_TILES_N 7
+#define GROUP_DESC_SIZE 8
+__kernel void sgemm_grouped(const int count, const __global int* desc,
+					const __global float* a,
+					const __global float* b,
+					__global float* c) {{
+
+	// find the problem of this tile, the last one that starts at or before it
+	const int tile = get_group_id(0);
+	int lo = 0, hi = count - 1;
+	while(lo < hi) {{
+		const int mid = (lo + hi + 1)/2;
+		if(desc[mid*GROUP_DESC_SIZE + GROUP_FIRST_TILE] <= tile)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}}
+	const __global int* problem = desc + lo*GROUP_DESC_SIZE;
+	const int M = problem[GROUP_M];
+	const int N = problem[GROUP_N];
+	const int K = problem[GROUP_K];
+	const int ptile = tile - problem[GROUP_FIRST_TILE];
+	const int tilesn = problem[GROUP_TILES_N];
+
+	__local float BA[BK][BM];
+	__local float BB[BK][BN];
+
+	sgemm_tile(M, N, K, 1.0f,
+		a + problem[GROUP_OFFSET_A], K,
+		b + problem[GROUP_OFFSET_B], N,
+		0.0f,
+		c + problem[GROUP_OFFSET_C], N,
+		BM*(ptile / tilesn), BN*(ptile % tilesn),
+		BA, BB);
+}}
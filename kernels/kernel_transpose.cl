@@ -22,11 +22,18 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+// storage type of the matrices, half (DTYPE_ID 1) and bfloat16 (DTYPE_ID 2) are copied as raw 16 bits
+#if defined(DTYPE_ID) && DTYPE_ID > 0
+#define ETYPE ushort
+#else
+#define ETYPE float
+#endif
+
 // Simple transpose kernel for a P * Q matrix
 __kernel void transpose(const int M, const int K,
 						const int K2, const int M2,
-                        const __global float* input,
-                        __global float* output) {{
+                        const __global ETYPE* input,
+                        __global ETYPE* output) {{
 	int row = get_global_id(0);
 	int col = get_global_id(1);
 	
@@ -0,0 +1,217 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "buffer_pool.h"
+
+// smallest size class, also the alignment of the classes
+#define MIN_CLASS_SIZE (4 * 1024)
+#define DEFAULT_MAX_IDLE_BYTES ((size_t)256 * 1024 * 1024)
+
+typedef struct PooledBuffer
+{
+	cl_context context;
+	cl_mem buffer;
+	size_t size; // size class
+	bool in_use;
+	unsigned long long last_used; // release order, the oldest idle buffers are trimmed first
+	struct PooledBuffer *next;
+} PooledBuffer;
+
+static PooledBuffer *buffers = NULL;
+static pthread_mutex_t pool_lock;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static unsigned long long release_count = 0;
+static size_t max_idle_bytes = DEFAULT_MAX_IDLE_BYTES;
+static BufferPoolStats stats = {0};
+
+static void pool_init()
+{
+	pthread_mutex_init(&pool_lock, NULL);
+}
+
+// rounds up to 1, 1.25, 1.5 or 1.75 times a power of 2
+static size_t get_size_class(size_t size)
+{
+	if (size <= MIN_CLASS_SIZE)
+		return MIN_CLASS_SIZE;
+	size_t pow2 = MIN_CLASS_SIZE;
+	while (pow2 * 2 < size)
+		pow2 *= 2;
+	size_t step = pow2 / 4;
+	return (size + step - 1) / step * step;
+}
+
+// needs the pool lock
+static void trim_idle(size_t max_bytes)
+{
+	while (stats.bytes_idle > max_bytes)
+	{
+		PooledBuffer **oldest = NULL;
+		for (PooledBuffer **entry = &buffers; *entry != NULL; entry = &(*entry)->next)
+		{
+			if (!(*entry)->in_use && (oldest == NULL || (*entry)->last_used < (*oldest)->last_used))
+				oldest = entry;
+		}
+		if (oldest == NULL)
+			break;
+		PooledBuffer *pooled = *oldest;
+		*oldest = pooled->next;
+		clReleaseMemObject(pooled->buffer);
+		stats.bytes_idle -= pooled->size;
+		stats.releases++;
+		free(pooled);
+	}
+}
+
+cl_mem buffer_pool_acquire(cl_context context, size_t size)
+{
+	pthread_once(&pool_once, pool_init);
+	size_t class_size = get_size_class(size);
+
+	pthread_mutex_lock(&pool_lock);
+	// the most recently used buffer of the class
+	PooledBuffer *found = NULL;
+	for (PooledBuffer *entry = buffers; entry != NULL; entry = entry->next)
+	{
+		if (!entry->in_use && entry->context == context && entry->size == class_size &&
+			(found == NULL || entry->last_used > found->last_used))
+			found = entry;
+	}
+	if (found != NULL)
+	{
+		found->in_use = true;
+		stats.reuses++;
+		stats.bytes_idle -= class_size;
+		stats.bytes_in_use += class_size;
+		pthread_mutex_unlock(&pool_lock);
+		return found->buffer;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	cl_int err;
+	cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, class_size, NULL, &err);
+	if (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+	{
+		// the idle buffers might be holding the memory
+		pthread_mutex_lock(&pool_lock);
+		trim_idle(0);
+		pthread_mutex_unlock(&pool_lock);
+		buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, class_size, NULL, &err);
+	}
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not create buffer of size: %zu, code: %d\n", class_size, err);
+		exit(1);
+	}
+
+	PooledBuffer *pooled = (PooledBuffer *)malloc(sizeof(PooledBuffer));
+	pooled->context = context;
+	pooled->buffer = buffer;
+	pooled->size = class_size;
+	pooled->in_use = true;
+	pooled->last_used = 0;
+	pthread_mutex_lock(&pool_lock);
+	pooled->next = buffers;
+	buffers = pooled;
+	stats.allocations++;
+	stats.bytes_in_use += class_size;
+	if (stats.bytes_in_use + stats.bytes_idle > stats.high_water)
+		stats.high_water = stats.bytes_in_use + stats.bytes_idle;
+	pthread_mutex_unlock(&pool_lock);
+	return buffer;
+}
+
+void buffer_pool_release(cl_mem buffer)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_lock);
+	PooledBuffer *entry;
+	for (entry = buffers; entry != NULL; entry = entry->next)
+	{
+		if (entry->buffer == buffer && entry->in_use)
+			break;
+	}
+	if (entry == NULL)
+	{
+		pthread_mutex_unlock(&pool_lock);
+		printf("Could not release buffer, not acquired from the pool\n");
+		exit(1);
+	}
+	entry->in_use = false;
+	entry->last_used = ++release_count;
+	stats.bytes_in_use -= entry->size;
+	stats.bytes_idle += entry->size;
+	trim_idle(max_idle_bytes);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void buffer_pool_set_limit(size_t max_bytes)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_lock);
+	max_idle_bytes = max_bytes;
+	trim_idle(max_idle_bytes);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void buffer_pool_trim(size_t max_bytes)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_lock);
+	trim_idle(max_bytes);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void buffer_pool_get_stats(BufferPoolStats *pool_stats)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_lock);
+	*pool_stats = stats;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void buffer_pool_print_stats()
+{
+	BufferPoolStats pool_stats;
+	buffer_pool_get_stats(&pool_stats);
+	printf("buffer pool allocations: %zu, reuses: %zu, releases: %zu\n",
+		   pool_stats.allocations, pool_stats.reuses, pool_stats.releases);
+	printf("buffer pool bytes in use: %zu, idle: %zu, high water: %zu\n",
+		   pool_stats.bytes_in_use, pool_stats.bytes_idle, pool_stats.high_water);
+}
+
+void buffer_pool_close()
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_lock);
+	trim_idle(0);
+	if (stats.bytes_in_use > 0)
+		printf("buffer pool closed with buffers in use: %zu bytes\n", stats.bytes_in_use);
+	pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,131 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdbool.h>
+
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static int cpu_simd_level = -1;
+static int max_simd_level = SIMD_AVX512;
+
+#ifdef CPU_X86
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex((int *)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state enabled by the os
+static unsigned long long xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static int detect_simd_level()
+{
+	unsigned int regs[4];
+	cpuid(0, 0, regs);
+	unsigned int max_leaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse42 = (regs[2] >> 20) & 1;
+	bool fma = (regs[2] >> 12) & 1;
+	bool osxsave = (regs[2] >> 27) & 1;
+	bool avx = (regs[2] >> 28) & 1;
+	if (!sse42)
+		return SIMD_NONE;
+
+	// avx needs the os to save the ymm (and zmm for avx512) registers
+	unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+	bool os_ymm = (xcr0 & 0x6) == 0x6;
+	bool os_zmm = (xcr0 & 0xe6) == 0xe6;
+	if (!avx || !fma || !os_ymm || max_leaf < 7)
+		return SIMD_SSE42;
+
+	cpuid(7, 0, regs);
+	bool avx2 = (regs[1] >> 5) & 1;
+	bool avx512f = (regs[1] >> 16) & 1;
+	if (!avx2)
+		return SIMD_SSE42;
+	if (!avx512f || !os_zmm)
+		return SIMD_AVX2;
+	return SIMD_AVX512;
+}
+#else
+static int detect_simd_level()
+{
+	return SIMD_NONE;
+}
+#endif
+
+int get_cpu_simd_level()
+{
+	if (cpu_simd_level < 0)
+		cpu_simd_level = detect_simd_level();
+	return cpu_simd_level;
+}
+
+int get_simd_level()
+{
+	int level = get_cpu_simd_level();
+	return level < max_simd_level ? level : max_simd_level;
+}
+
+void set_max_simd_level(int level)
+{
+	max_simd_level = level;
+}
+
+const char *simd_level_name(int level)
+{
+	switch (level)
+	{
+	case SIMD_SSE42:
+		return "sse4.2";
+	case SIMD_AVX2:
+		return "avx2+fma";
+	case SIMD_AVX512:
+		return "avx512f";
+	default:
+		return "scalar";
+	}
+}
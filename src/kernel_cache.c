@@ -0,0 +1,546 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "kernel_cache.h"
+#include "kernel_sources.h"
+#include "opencl_tools.h"
+
+#define PROGRAM_BUILDING 0
+#define PROGRAM_READY 1
+#define PROGRAM_FAILED 2
+
+typedef struct CachedKernel
+{
+	char *name;
+	cl_kernel kernel;
+	struct CachedKernel *next;
+} CachedKernel;
+
+// one program per kernel file and defines, with the kernels created from it
+typedef struct CachedProgram
+{
+	cl_context context;
+	cl_device_id device_id;
+	char *kernel_file;
+	char *defines;
+	cl_program program;
+	int state;
+	CachedKernel *kernels;
+	struct CachedProgram *next;
+} CachedProgram;
+
+typedef struct WarmupTask
+{
+	cl_context context;
+	cl_device_id device_id;
+	int count;
+	char **kernel_files;
+	char **kernel_names;
+	char **defines;
+} WarmupTask;
+
+static CachedProgram *programs = NULL;
+static pthread_mutex_t cache_lock;
+static pthread_cond_t cache_built; // signaled when a program leaves the building state
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+// the warm up thread and its state are guarded by cache_lock, it is joined outside of the lock
+static pthread_t warmup_thread;
+static bool warmup_running = false;
+static int builds = 0;
+static int binary_loads = 0;
+static char *binary_cache_dir = NULL;
+
+static void cache_init()
+{
+	pthread_mutex_init(&cache_lock, NULL);
+	pthread_cond_init(&cache_built, NULL);
+	binary_cache_dir = get_cache_path("MATMUL_KERNEL_CACHE_DIR", "kernels");
+}
+
+// 64-bit FNV-1a, chained over the parts of the binary cache key
+static unsigned long long hash_str(unsigned long long hash, const char *str)
+{
+	// include the terminator so the parts can not run into each other
+	do
+	{
+		hash ^= (unsigned char)*str;
+		hash *= 0x100000001b3ULL;
+	} while (*str++);
+	return hash;
+}
+
+static bool get_device_str(cl_device_id device_id, cl_device_info param, char *value, size_t size)
+{
+	value[0] = '\0';
+	return clGetDeviceInfo(device_id, param, size, value, NULL) == CL_SUCCESS;
+}
+
+// the binary is only valid for the same device, driver and source so they are all part of the file name
+// returns NULL if the cache is disabled
+static char *get_binary_path(cl_device_id device_id, const char *kernel_file, const char *source)
+{
+	char device_name[256];
+	char driver_version[256];
+	if (!get_device_str(device_id, CL_DEVICE_NAME, device_name, sizeof(device_name)) ||
+		!get_device_str(device_id, CL_DRIVER_VERSION, driver_version, sizeof(driver_version)))
+		return NULL;
+
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	hash = hash_str(hash, device_name);
+	hash = hash_str(hash, driver_version);
+	hash = hash_str(hash, source);
+
+	// file name without the directory and extension
+	const char *name = kernel_file;
+	for (const char *p = kernel_file; *p; p++)
+	{
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+	size_t name_len = strcspn(name, ".");
+	char *path = NULL;
+	pthread_mutex_lock(&cache_lock);
+	if (binary_cache_dir != NULL)
+	{
+		path = (char *)malloc(strlen(binary_cache_dir) + name_len + 24);
+		sprintf(path, "%s/%.*s_%016llx.bin", binary_cache_dir, (int)name_len, name, hash);
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return path;
+}
+
+static cl_program load_binary(cl_context context, cl_device_id device_id, const char *path)
+{
+	cl_int err;
+	cl_int status;
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size <= 0)
+	{
+		fclose(file);
+		return NULL;
+	}
+	unsigned char *binary = (unsigned char *)malloc(size);
+	size_t length = fread(binary, 1, size, file);
+	fclose(file);
+
+	cl_program program = clCreateProgramWithBinary(context, 1, &device_id, &length,
+												   (const unsigned char **)&binary, &status, &err);
+	free(binary);
+	if (err != CL_SUCCESS || status != CL_SUCCESS)
+	{
+		if (program)
+			clReleaseProgram(program);
+		return NULL;
+	}
+	// binaries still need to be built, this only links them
+	err = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		clReleaseProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+// saves to a temporary file first so other processes never load a partial binary
+// the program has an entry per device of the context (ie: multi device), only the built device has a binary
+static void save_binary(cl_program program, cl_device_id device_id, const char *path)
+{
+	cl_uint num_devices = 0;
+	cl_int err = clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint), &num_devices, NULL);
+	if (err != CL_SUCCESS || num_devices == 0)
+		return;
+	cl_device_id *devices = (cl_device_id *)malloc(num_devices * sizeof(cl_device_id));
+	size_t *sizes = (size_t *)malloc(num_devices * sizeof(size_t));
+	unsigned char **binaries = (unsigned char **)calloc(num_devices, sizeof(unsigned char *));
+	err = clGetProgramInfo(program, CL_PROGRAM_DEVICES, num_devices * sizeof(cl_device_id), devices, NULL);
+	err |= clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, num_devices * sizeof(size_t), sizes, NULL);
+	cl_uint index = 0;
+	while (index < num_devices && devices[index] != device_id)
+		index++;
+	size_t size = err == CL_SUCCESS && index < num_devices ? sizes[index] : 0;
+	free(devices);
+	free(sizes);
+	if (size == 0)
+	{
+		free(binaries);
+		return;
+	}
+	// the entries of the other devices stay NULL so they are skipped
+	binaries[index] = (unsigned char *)malloc(size);
+	err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, num_devices * sizeof(unsigned char *), binaries, NULL);
+	unsigned char *binary = binaries[index];
+	free(binaries);
+	if (err != CL_SUCCESS)
+	{
+		free(binary);
+		return;
+	}
+
+	make_dirs(path);
+	char *tmp_path = (char *)malloc(strlen(path) + 32);
+	sprintf(tmp_path, "%s.%p.tmp", path, (void *)program);
+	FILE *file = fopen(tmp_path, "wb");
+	if (file != NULL)
+	{
+		bool written = fwrite(binary, 1, size, file) == size;
+		written = fclose(file) == 0 && written;
+		if (written)
+		{
+			// rename does not replace existing files on windows
+			remove(path);
+			written = rename(tmp_path, path) == 0;
+		}
+		if (!written)
+			remove(tmp_path);
+	}
+	free(tmp_path);
+	free(binary);
+}
+
+// loaded is set if the program was created from a cached binary, save writes the binary of a compiled one
+static cl_program build_program(cl_context context, cl_device_id device_id, const char *kernel_file, const char *defines,
+								bool save, bool *loaded)
+{
+	cl_program program;
+	cl_int err;
+
+	char *kernel_source = get_kernel_source(kernel_file);
+	if (kernel_source == NULL)
+	{
+		printf("Could not open kernel file: %s\n", kernel_file);
+		return NULL;
+	}
+	char *source_str = (char *)malloc(strlen(defines) + strlen(kernel_source) + 1);
+	strcpy(source_str, defines);
+	strcat(source_str, kernel_source);
+	free(kernel_source);
+
+	char *binary_path = get_binary_path(device_id, kernel_file, source_str);
+	*loaded = false;
+	if (binary_path != NULL)
+	{
+		program = load_binary(context, device_id, binary_path);
+		if (program != NULL)
+		{
+			*loaded = true;
+			free(binary_path);
+			free(source_str);
+			return program;
+		}
+	}
+
+	program = clCreateProgramWithSource(context, 1, (const char **)&source_str, NULL, &err);
+	free(source_str);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not create program: %s, code: %d\n", kernel_file, err);
+		free(binary_path);
+		return NULL;
+	}
+
+	err = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not build program: %s, code: %d\n", kernel_file, err);
+		if (err == CL_BUILD_PROGRAM_FAILURE)
+		{
+			printBuildError(device_id, program);
+		}
+		clReleaseProgram(program);
+		free(binary_path);
+		return NULL;
+	}
+	if (save && binary_path != NULL)
+		save_binary(program, device_id, binary_path);
+	free(binary_path);
+	return program;
+}
+
+// finds the program or adds it in the building state, in which case the caller has to build it
+// needs the cache lock
+static CachedProgram *find_program(cl_context context, cl_device_id device_id,
+								   const char *kernel_file, const char *defines, bool *build)
+{
+	CachedProgram *entry;
+	for (entry = programs; entry != NULL; entry = entry->next)
+	{
+		if (entry->context == context && entry->device_id == device_id &&
+			strcmp(entry->kernel_file, kernel_file) == 0 && strcmp(entry->defines, defines) == 0)
+		{
+			*build = false;
+			return entry;
+		}
+	}
+	entry = (CachedProgram *)calloc(1, sizeof(CachedProgram));
+	entry->context = context;
+	entry->device_id = device_id;
+	entry->kernel_file = copy_str(kernel_file);
+	entry->defines = copy_str(defines);
+	entry->state = PROGRAM_BUILDING;
+	entry->next = programs;
+	programs = entry;
+	*build = true;
+	return entry;
+}
+
+// builds the program outside of the lock so other programs can be used meanwhile
+static void build_entry(CachedProgram *entry)
+{
+	bool loaded;
+	cl_program program = build_program(entry->context, entry->device_id, entry->kernel_file, entry->defines, true, &loaded);
+	pthread_mutex_lock(&cache_lock);
+	entry->program = program;
+	entry->state = program ? PROGRAM_READY : PROGRAM_FAILED;
+	builds++;
+	if (loaded)
+		binary_loads++;
+	pthread_cond_broadcast(&cache_built);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+// returns NULL if the program could not be built or the kernel created
+static cl_kernel get_kernel(cl_context context, cl_device_id device_id,
+							const char *kernel_file, const char *kernel_name, const char *defines)
+{
+	bool build;
+	cl_int err;
+
+	pthread_once(&cache_once, cache_init);
+	if (defines == NULL)
+		defines = "";
+
+	pthread_mutex_lock(&cache_lock);
+	CachedProgram *entry = find_program(context, device_id, kernel_file, defines, &build);
+	pthread_mutex_unlock(&cache_lock);
+	if (build)
+		build_entry(entry);
+
+	pthread_mutex_lock(&cache_lock);
+	while (entry->state == PROGRAM_BUILDING)
+		pthread_cond_wait(&cache_built, &cache_lock);
+	cl_kernel kernel = NULL;
+	if (entry->state == PROGRAM_READY)
+	{
+		CachedKernel *cached;
+		for (cached = entry->kernels; cached != NULL; cached = cached->next)
+		{
+			if (strcmp(cached->name, kernel_name) == 0)
+				break;
+		}
+		if (cached == NULL)
+		{
+			kernel = clCreateKernel(entry->program, kernel_name, &err);
+			if (err != CL_SUCCESS)
+			{
+				printf("Could not create kernel: %s, code: %d\n", kernel_name, err);
+			}
+			else
+			{
+				cached = (CachedKernel *)malloc(sizeof(CachedKernel));
+				cached->name = copy_str(kernel_name);
+				cached->kernel = kernel;
+				cached->next = entry->kernels;
+				entry->kernels = cached;
+			}
+		}
+		else
+		{
+			kernel = cached->kernel;
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return kernel;
+}
+
+cl_kernel kernel_cache_get(cl_context context, cl_device_id device_id,
+						   const char *kernel_file, const char *kernel_name, const char *defines)
+{
+	cl_kernel kernel = get_kernel(context, device_id, kernel_file, kernel_name, defines);
+	if (kernel == NULL)
+	{
+		printf("Could not get kernel: %s from: %s\n", kernel_name, kernel_file);
+		exit(1);
+	}
+	return kernel;
+}
+
+cl_kernel kernel_cache_build(cl_context context, cl_device_id device_id, const char *kernel_file,
+							 const char *kernel_name, const char *defines, cl_program *program)
+{
+	bool loaded;
+	cl_int err;
+
+	pthread_once(&cache_once, cache_init);
+	*program = build_program(context, device_id, kernel_file, defines ? defines : "", false, &loaded);
+	if (*program == NULL)
+		return NULL;
+	cl_kernel kernel = clCreateKernel(*program, kernel_name, &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not create kernel: %s, code: %d\n", kernel_name, err);
+		clReleaseProgram(*program);
+		*program = NULL;
+		return NULL;
+	}
+	return kernel;
+}
+
+static void *warmup_run(void *arg)
+{
+	WarmupTask *task = (WarmupTask *)arg;
+	for (int i = 0; i < task->count; i++)
+	{
+		// failures are reported again when the kernel is used
+		get_kernel(task->context, task->device_id, task->kernel_files[i], task->kernel_names[i], task->defines[i]);
+		free(task->kernel_files[i]);
+		free(task->kernel_names[i]);
+		free(task->defines[i]);
+	}
+	printf("kernel cache warm up done, programs built: %d\n", kernel_cache_builds());
+	free(task->kernel_files);
+	free(task->kernel_names);
+	free(task->defines);
+	free(task);
+	return NULL;
+}
+
+// waits for the running warm up if any
+static void join_warmup()
+{
+	pthread_mutex_lock(&cache_lock);
+	bool running = warmup_running;
+	pthread_t thread = warmup_thread;
+	warmup_running = false;
+	pthread_mutex_unlock(&cache_lock);
+	if (running)
+		pthread_join(thread, NULL);
+}
+
+void kernel_cache_warmup(cl_context context, cl_device_id device_id, int count,
+						 const char **kernel_files, const char **kernel_names, const char **defines)
+{
+	pthread_once(&cache_once, cache_init);
+	// one warm up at a time
+	join_warmup();
+
+	WarmupTask *task = (WarmupTask *)malloc(sizeof(WarmupTask));
+	task->context = context;
+	task->device_id = device_id;
+	task->count = count;
+	task->kernel_files = (char **)malloc(count * sizeof(char *));
+	task->kernel_names = (char **)malloc(count * sizeof(char *));
+	task->defines = (char **)malloc(count * sizeof(char *));
+	for (int i = 0; i < count; i++)
+	{
+		task->kernel_files[i] = copy_str(kernel_files[i]);
+		task->kernel_names[i] = copy_str(kernel_names[i]);
+		task->defines[i] = copy_str(defines && defines[i] ? defines[i] : "");
+	}
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, warmup_run, task) != 0)
+	{
+		printf("Could not start kernel cache warm up thread\n");
+		warmup_run(task);
+		return;
+	}
+	// a concurrent warm up may have started meanwhile, it is joined so no thread is left behind
+	pthread_mutex_lock(&cache_lock);
+	bool running = warmup_running;
+	pthread_t other = warmup_thread;
+	warmup_thread = thread;
+	warmup_running = true;
+	pthread_mutex_unlock(&cache_lock);
+	if (running)
+		pthread_join(other, NULL);
+}
+
+int kernel_cache_builds()
+{
+	pthread_once(&cache_once, cache_init);
+	pthread_mutex_lock(&cache_lock);
+	int count = builds;
+	pthread_mutex_unlock(&cache_lock);
+	return count;
+}
+
+int kernel_cache_binary_loads()
+{
+	pthread_once(&cache_once, cache_init);
+	pthread_mutex_lock(&cache_lock);
+	int count = binary_loads;
+	pthread_mutex_unlock(&cache_lock);
+	return count;
+}
+
+void kernel_cache_set_dir(const char *dir)
+{
+	pthread_once(&cache_once, cache_init);
+	pthread_mutex_lock(&cache_lock);
+	free(binary_cache_dir);
+	binary_cache_dir = dir ? copy_str(dir) : NULL;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void kernel_cache_close()
+{
+	pthread_once(&cache_once, cache_init);
+	join_warmup();
+
+	pthread_mutex_lock(&cache_lock);
+	CachedProgram *entry = programs;
+	while (entry != NULL)
+	{
+		CachedKernel *cached = entry->kernels;
+		while (cached != NULL)
+		{
+			CachedKernel *next_kernel = cached->next;
+			clReleaseKernel(cached->kernel);
+			free(cached->name);
+			free(cached);
+			cached = next_kernel;
+		}
+		if (entry->program)
+			clReleaseProgram(entry->program);
+		CachedProgram *next = entry->next;
+		free(entry->kernel_file);
+		free(entry->defines);
+		free(entry);
+		entry = next;
+	}
+	programs = NULL;
+	pthread_mutex_unlock(&cache_lock);
+}
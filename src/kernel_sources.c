@@ -0,0 +1,81 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel_sources.h"
+#include "opencl_tools.h"
+// generated by cmake/embed_kernels.cmake
+#include "kernel_sources_gen.h"
+
+static char *kernel_source_dir = NULL;
+
+void set_kernel_source_dir(const char *dir)
+{
+	free(kernel_source_dir);
+	kernel_source_dir = NULL;
+	if (dir)
+	{
+		kernel_source_dir = (char *)malloc(strlen(dir) + 1);
+		strcpy(kernel_source_dir, dir);
+	}
+}
+
+static char *read_kernel_file(const char *path)
+{
+	FILE *cl_code = fopen(path, "rb");
+	if (cl_code == NULL)
+		return NULL;
+	char *source_str = (char *)malloc(MAX_SOURCE_SIZE + 1);
+	size_t res = fread(source_str, 1, MAX_SOURCE_SIZE, cl_code);
+	source_str[res] = '\0';
+	fclose(cl_code);
+	return source_str;
+}
+
+char *get_kernel_source(const char *kernel_file)
+{
+	if (kernel_source_dir)
+	{
+		char *path = (char *)malloc(strlen(kernel_source_dir) + strlen(kernel_file) + 2);
+		sprintf(path, "%s/%s", kernel_source_dir, kernel_file);
+		char *source_str = read_kernel_file(path);
+		free(path);
+		return source_str;
+	}
+
+	for (int i = 0; embedded_kernel_sources[i].name != NULL; i++)
+	{
+		if (strcmp(embedded_kernel_sources[i].name, kernel_file) == 0)
+		{
+			const char *source = embedded_kernel_sources[i].source;
+			char *source_str = (char *)malloc(strlen(source) + 1);
+			strcpy(source_str, source);
+			return source_str;
+		}
+	}
+	return read_kernel_file(kernel_file);
+}
@@ -27,8 +27,20 @@ SOFTWARE.
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdint.h>
+#include <math.h>
 
 #include "mat_tools.h"
+#include "cpu_features.h"
+#include "matmult_kernels.h"
+#include "thread_pool.h"
+
+// transpose blocks up to this size (per dim) are done directly, 64*64 floats fit in L1
+#define TRANSPOSE_LEAF_SIZE 64
+// size (per dim) of the blocks given to each thread pool task
+#define TRANSPOSE_TASK_SIZE 256
+// below this many elements the transpose runs on the calling thread
+#define TRANSPOSE_PARALLEL_MIN_SIZE (512 * 512)
 
 float *create(int sizeA, int sizeB, float val)
 {
@@ -37,17 +49,184 @@ float *create(int sizeA, int sizeB, float val)
 	return mat;
 }
 
+void *aligned_malloc(size_t size)
+{
+	// keep the original pointer right before the aligned block
+	void *raw = malloc(size + MEM_ALIGNMENT + sizeof(void *));
+	if (raw == NULL)
+		return NULL;
+	uintptr_t addr = ((uintptr_t)raw + sizeof(void *) + MEM_ALIGNMENT - 1) & ~(uintptr_t)(MEM_ALIGNMENT - 1);
+	((void **)addr)[-1] = raw;
+	return (void *)addr;
+}
+
+void aligned_free(void *mem)
+{
+	if (mem != NULL)
+		free(((void **)mem)[-1]);
+}
+
+typedef struct TransposeContext
+{
+	const TransposeKernel *kernel;
+	int m;
+	int n;
+	const float *src;
+	int lds;
+	float *dst;
+	int ldd;
+	int tiles_n;
+} TransposeContext;
+
+// leaf: in-register tiles where they fit, scalar for the edges
+static void transpose_leaf(const TransposeKernel *kernel, int m, int n, const float *src, int lds, float *dst, int ldd)
+{
+	int i = 0, j = 0;
+	if (kernel != NULL)
+	{
+		int ts = kernel->size;
+		for (i = 0; i + ts <= m; i += ts)
+		{
+			for (j = 0; j + ts <= n; j += ts)
+			{
+				kernel->kernel(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+			}
+			// right edge
+			for (int ii = i; ii < i + ts; ii++)
+			{
+				for (int jj = j; jj < n; jj++)
+				{
+					*(dst + jj * ldd + ii) = *(src + ii * lds + jj);
+				}
+			}
+		}
+	}
+	// bottom edge
+	for (; i < m; i++)
+	{
+		for (j = 0; j < n; j++)
+		{
+			*(dst + j * ldd + i) = *(src + i * lds + j);
+		}
+	}
+}
+
+// cache oblivious: split the larger dim in halves until the block fits in L1
+static void transpose_rec(const TransposeKernel *kernel, int m, int n, const float *src, int lds, float *dst, int ldd)
+{
+	if (m <= TRANSPOSE_LEAF_SIZE && n <= TRANSPOSE_LEAF_SIZE)
+	{
+		transpose_leaf(kernel, m, n, src, lds, dst, ldd);
+	}
+	else if (m >= n)
+	{
+		int m2 = m / 2;
+		transpose_rec(kernel, m2, n, src, lds, dst, ldd);
+		transpose_rec(kernel, m - m2, n, src + m2 * lds, lds, dst + m2, ldd);
+	}
+	else
+	{
+		int n2 = n / 2;
+		transpose_rec(kernel, m, n2, src, lds, dst, ldd);
+		transpose_rec(kernel, m, n - n2, src + n2, lds, dst + n2 * ldd, ldd);
+	}
+}
+
+static void transpose_task(void *ctx, int task, int worker)
+{
+	TransposeContext *t = (TransposeContext *)ctx;
+	int i = (task / t->tiles_n) * TRANSPOSE_TASK_SIZE;
+	int j = (task % t->tiles_n) * TRANSPOSE_TASK_SIZE;
+	int m = t->m - i < TRANSPOSE_TASK_SIZE ? t->m - i : TRANSPOSE_TASK_SIZE;
+	int n = t->n - j < TRANSPOSE_TASK_SIZE ? t->n - j : TRANSPOSE_TASK_SIZE;
+	transpose_rec(t->kernel, m, n, t->src + i * t->lds + j, t->lds, t->dst + j * t->ldd + i, t->ldd);
+}
+
+// mat is dims.m * dims.n, mat2 is dims.tm * dims.tn with tm >= n and tn >= m (padding is left untouched)
 void transpose(MatTransposeDims dims, float *mat, float *mat2)
 {
-	// printf("tr: %dx%d => %dx%d\n", dims.m, dims.n, dims.tm, dims.tn);
-	for (int i = 0; i < dims.m; i++)
+	TransposeContext t;
+	t.kernel = get_transpose_kernel(get_simd_level());
+	t.m = dims.m;
+	t.n = dims.n;
+	t.src = mat;
+	t.lds = dims.n;
+	t.dst = mat2;
+	t.ldd = dims.tn;
+	t.tiles_n = (dims.n + TRANSPOSE_TASK_SIZE - 1) / TRANSPOSE_TASK_SIZE;
+	int tiles_m = (dims.m + TRANSPOSE_TASK_SIZE - 1) / TRANSPOSE_TASK_SIZE;
+	int tasks = tiles_m * t.tiles_n;
+	if ((long long)dims.m * dims.n < TRANSPOSE_PARALLEL_MIN_SIZE)
+	{
+		for (int i = 0; i < tasks; i++)
+		{
+			transpose_task(&t, i, 0);
+		}
+	}
+	else
+	{
+		thread_pool_run(tasks, transpose_task, &t);
+	}
+}
+
+typedef struct TransposeInplaceContext
+{
+	const TransposeKernel *kernel;
+	int n;
+	float *mat;
+	int tiles;
+} TransposeInplaceContext;
+
+// swap tile (ti,tj) with the transpose of tile (tj,ti), tasks only cover ti <= tj
+static void transpose_inplace_task(void *ctx, int task, int worker)
+{
+	TransposeInplaceContext *t = (TransposeInplaceContext *)ctx;
+	int ti = 0, tj = task;
+	while (tj >= t->tiles - ti)
 	{
-		for (int j = 0; j < dims.n; j++)
+		tj -= t->tiles - ti;
+		ti++;
+	}
+	tj += ti;
+
+	float tmp[TRANSPOSE_LEAF_SIZE * TRANSPOSE_LEAF_SIZE];
+	int i = ti * TRANSPOSE_LEAF_SIZE;
+	int j = tj * TRANSPOSE_LEAF_SIZE;
+	int m = t->n - i < TRANSPOSE_LEAF_SIZE ? t->n - i : TRANSPOSE_LEAF_SIZE;
+	int n = t->n - j < TRANSPOSE_LEAF_SIZE ? t->n - j : TRANSPOSE_LEAF_SIZE;
+	float *ij = t->mat + i * t->n + j;
+	float *ji = t->mat + j * t->n + i;
+
+	// tmp = (tile ij)^T, tile ij = (tile ji)^T, tile ji = tmp
+	transpose_rec(t->kernel, m, n, ij, t->n, tmp, m);
+	if (ti != tj)
+		transpose_rec(t->kernel, n, m, ji, t->n, ij, t->n);
+	for (int r = 0; r < n; r++)
+	{
+		memcpy(ji + r * t->n, tmp + r * m, m * sizeof(float));
+	}
+}
+
+// in-place transpose of a square n * n matrix
+void transpose_inplace(int n, float *mat)
+{
+	TransposeInplaceContext t;
+	t.kernel = get_transpose_kernel(get_simd_level());
+	t.n = n;
+	t.mat = mat;
+	t.tiles = (n + TRANSPOSE_LEAF_SIZE - 1) / TRANSPOSE_LEAF_SIZE;
+	int tasks = t.tiles * (t.tiles + 1) / 2;
+	if ((long long)n * n < TRANSPOSE_PARALLEL_MIN_SIZE)
+	{
+		for (int i = 0; i < tasks; i++)
 		{
-			// printf("%d => %d\n", i*sizeB + j, j*sizeA2 + i);
-			*(mat2 + j * dims.tn + i) = *(mat + i * dims.tm + j);
+			transpose_inplace_task(&t, i, 0);
 		}
 	}
+	else
+	{
+		thread_pool_run(tasks, transpose_inplace_task, &t);
+	}
 }
 
 void copy_mat(int sizeA1, int sizeB1, float *mat1, int sizeA2, int sizeB2, float *mat2, int lengthA, int lengthB)
@@ -80,6 +259,20 @@ void assert_mat_equal(int sizeA, int sizeB, float *mat1, float *mat2)
 	}
 }
 
+// for reduced precision results, the error is relative to the magnitude of the values
+void assert_mat_near(int sizeA, int sizeB, float *mat1, float *mat2, float tolerance)
+{
+	for (int i = 0; i < sizeA; i++)
+	{
+		for (int j = 0; j < sizeB; j++)
+		{
+			float val1 = *(mat1 + i * sizeB + j);
+			float val2 = *(mat2 + i * sizeB + j);
+			assert(fabsf(val1 - val2) <= tolerance * fmaxf(fabsf(val2), 1.0f) && "not near");
+		}
+	}
+}
+
 void print_matrix(const char *header, float *m, int rows, int cols)
 {
 	printf("%s %dx%d\r\n", header, rows, cols);
@@ -125,6 +318,41 @@ bool is_power_two(int val)
 	return (int)(val & (val - 1)) == 0;
 }
 
+// the vectors of VEC elements must not cross the rows of the tiles or the work item parts
+static bool is_valid_vec(TileParams tile_params)
+{
+	int VEC = tile_params.VEC;
+	if (VEC < 1 || VEC > 16 || !is_power_two(VEC))
+		return false;
+	const int WIA_SIZE = tile_params.BK * tile_params.WIM * tile_params.WIN / tile_params.BN;
+	const int WIB_SIZE = tile_params.BK * tile_params.WIM * tile_params.WIN / tile_params.BM;
+	return WIA_SIZE % VEC == 0 && WIB_SIZE % VEC == 0 && tile_params.WIN % VEC == 0 &&
+		   tile_params.BM % VEC == 0 && tile_params.BN % VEC == 0 && tile_params.BK % VEC == 0;
+}
+
+// same checks as validate_tiling without the messages, for filtering candidates
+bool is_valid_tiling(TileParams tile_params, int max_local_size)
+{
+	if (tile_params.BM < 1 || tile_params.BN < 1 || tile_params.BK < 1 || tile_params.WIM < 1 || tile_params.WIN < 1)
+		return false;
+	if (!is_power_two(tile_params.BM) || !is_power_two(tile_params.BK) || !is_power_two(tile_params.BN) || !is_power_two(tile_params.WIM) || !is_power_two(tile_params.WIN))
+		return false;
+	if (tile_params.WIM > tile_params.BM || tile_params.WIN > tile_params.BN)
+		return false;
+	// the kernels number the work items of a group assuming square work groups
+	if (tile_params.BM / tile_params.WIM != tile_params.BN / tile_params.WIN)
+		return false;
+	if (!is_valid_vec(tile_params))
+		return false;
+	if (tile_params.DBUF != 0 && tile_params.DBUF != 1)
+		return false;
+	if (tile_params.LPAD < 0 || tile_params.LPAD > 32)
+		return false;
+	int WIPG = ((tile_params.BM * tile_params.BN) / (tile_params.WIM * tile_params.WIN)); // work items per workgroup
+	return (tile_params.BM * tile_params.BK) % WIPG == 0 && (tile_params.BN * tile_params.BK) % WIPG == 0 &&
+		   tile_params.BM / tile_params.WIM <= max_local_size && tile_params.BN / tile_params.WIN <= max_local_size;
+}
+
 void validate_tiling(TileParams tile_params, int max_local_size)
 {
 	if (!is_power_two(tile_params.BM) || !is_power_two(tile_params.BK) || !is_power_two(tile_params.BN) || !is_power_two(tile_params.WIM) || !is_power_two(tile_params.WIN))
@@ -168,6 +396,25 @@ void validate_tiling(TileParams tile_params, int max_local_size)
 		printf("%d / %d = %d > %d\r\n", tile_params.BN, tile_params.WIN, BNWIN, max_local_size);
 		exit(1);
 	}
+	if (!is_valid_vec(tile_params))
+	{
+		printf("Error: VEC should be a power of two up to 16 that divides BM, BN, BK, WIN and the work item parts\r\n");
+		printf("VEC = %d, BM = %d, BN = %d, BK = %d, WIN = %d\r\n",
+			   tile_params.VEC, tile_params.BM, tile_params.BN, tile_params.BK, tile_params.WIN);
+		exit(1);
+	}
+	if (tile_params.DBUF != 0 && tile_params.DBUF != 1)
+	{
+		printf("Error: DBUF should be 0 or 1\r\n");
+		printf("DBUF = %d\r\n", tile_params.DBUF);
+		exit(1);
+	}
+	if (tile_params.LPAD < 0 || tile_params.LPAD > 32)
+	{
+		printf("Error: LPAD should be between 0 and 32\r\n");
+		printf("LPAD = %d\r\n", tile_params.LPAD);
+		exit(1);
+	}
 }
 
 void set_default_tiling_params(TileParams *tile_params)
@@ -179,6 +426,9 @@ void set_default_tiling_params(TileParams *tile_params)
 	tile_params->BK = 16;  // block size for dimension K
 	tile_params->WIM = 8;  // work items/elements for dimension M
 	tile_params->WIN = 8;  // work items/elements for dimension N
+	tile_params->VEC = 1;  // scalar loads and stores, the tuner or the caller enables the vector kernels
+	tile_params->DBUF = 0; // single buffered local tiles
+	tile_params->LPAD = 0; // unpadded local tile rows, the tuner enables the padding against bank conflicts
 }
 
 void set_pref_tiling_params(MatMultDims dims, long max_local_size, TileParams *tile_params)
@@ -216,9 +466,157 @@ void set_pref_tiling_params(MatMultDims dims, long max_local_size, TileParams *t
 		tile_params->WIM = 8;
 		tile_params->WIN = 8;
 	}
+	// vector loads, double buffering and padding are enabled by the tuner when they pay off on the device
+	tile_params->VEC = 1;
+	tile_params->DBUF = 0;
+	tile_params->LPAD = 0;
 	// also these may be fast for large matrices with DTYPE=half for high end devices
 	// 256, 256, 4, 16, 16
 	// 256, 256, 8, 16, 16
 
 	printf("setting preferred tiling params\n");
-}
\ No newline at end of file
+}
+
+size_t dtype_size(int dtype)
+{
+	switch (dtype)
+	{
+	case MatFloat32:
+		return sizeof(float);
+	case MatFloat16:
+	case MatBFloat16:
+		return sizeof(uint16_t);
+	default:
+		printf("Error: unknown dtype: %d\n", dtype);
+		exit(1);
+	}
+}
+
+static uint32_t float_bits(float val)
+{
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+	float val;
+	memcpy(&val, &bits, sizeof(val));
+	return val;
+}
+
+// round to nearest even like vstore_half, overflows go to inf and small values to subnormals
+uint16_t float_to_half(float val)
+{
+	uint32_t bits = float_bits(val);
+	uint16_t sign = (bits >> 16) & 0x8000;
+	uint32_t exp = (bits >> 23) & 0xff;
+	uint32_t mant = bits & 0x7fffff;
+	if (exp == 0xff)
+		return sign | 0x7c00 | (mant ? 0x200 : 0); // inf or nan
+	int hexp = (int)exp - 127 + 15;
+	if (hexp >= 0x1f)
+		return sign | 0x7c00;
+	if (hexp <= 0)
+	{
+		if (hexp < -10)
+			return sign;
+		// subnormal, the implicit bit becomes part of the mantissa
+		mant |= 0x800000;
+		int shift = 14 - hexp;
+		uint32_t half_mant = mant >> shift;
+		uint32_t rest = mant & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half_mant & 1)))
+			half_mant++;
+		return sign | half_mant;
+	}
+	uint32_t half = ((uint32_t)hexp << 10) | (mant >> 13);
+	uint32_t rest = mant & 0x1fff;
+	// a carry out of the mantissa increments the exponent, up to inf
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return sign | half;
+}
+
+float half_to_float(uint16_t val)
+{
+	uint32_t sign = (uint32_t)(val & 0x8000) << 16;
+	uint32_t exp = (val >> 10) & 0x1f;
+	uint32_t mant = val & 0x3ff;
+	if (exp == 0x1f)
+		return bits_float(sign | 0x7f800000 | (mant << 13));
+	if (exp == 0)
+	{
+		if (mant == 0)
+			return bits_float(sign);
+		// subnormal, normalized for the float exponent
+		exp = 1;
+		while (!(mant & 0x400))
+		{
+			mant <<= 1;
+			exp--;
+		}
+		mant &= 0x3ff;
+	}
+	return bits_float(sign | ((exp + 127 - 15) << 23) | (mant << 13));
+}
+
+// round to nearest even, nans stay nans
+uint16_t float_to_bf16(float val)
+{
+	uint32_t bits = float_bits(val);
+	if ((bits & 0x7fffffff) > 0x7f800000)
+		return (bits >> 16) | 0x40;
+	return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+float bf16_to_float(uint16_t val)
+{
+	return bits_float((uint32_t)val << 16);
+}
+
+void convert_to_dtype(const float *src, void *dst, size_t count, int dtype)
+{
+	uint16_t *dst16 = (uint16_t *)dst;
+	switch (dtype)
+	{
+	case MatFloat32:
+		memcpy(dst, src, count * sizeof(float));
+		break;
+	case MatFloat16:
+		for (size_t i = 0; i < count; i++)
+			dst16[i] = float_to_half(src[i]);
+		break;
+	case MatBFloat16:
+		for (size_t i = 0; i < count; i++)
+			dst16[i] = float_to_bf16(src[i]);
+		break;
+	default:
+		printf("Error: unknown dtype: %d\n", dtype);
+		exit(1);
+	}
+}
+
+void convert_from_dtype(const void *src, float *dst, size_t count, int dtype)
+{
+	const uint16_t *src16 = (const uint16_t *)src;
+	switch (dtype)
+	{
+	case MatFloat32:
+		memcpy(dst, src, count * sizeof(float));
+		break;
+	case MatFloat16:
+		for (size_t i = 0; i < count; i++)
+			dst[i] = half_to_float(src16[i]);
+		break;
+	case MatBFloat16:
+		for (size_t i = 0; i < count; i++)
+			dst[i] = bf16_to_float(src16[i]);
+		break;
+	default:
+		printf("Error: unknown dtype: %d\n", dtype);
+		exit(1);
+	}
+}
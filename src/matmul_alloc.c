@@ -0,0 +1,172 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <CL/opencl.h>
+#include "matmul_alloc.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#define aligned_free(ptr) _aligned_free(ptr)
+#else
+#define aligned_free(ptr) free(ptr)
+#endif
+
+// page alignment, also what the runtimes need to use host memory without copies
+#define MIN_ALLOC_ALIGN 4096
+
+extern cl_context context;
+extern cl_command_queue queue;
+extern cl_device_svm_capabilities svm_capabilities;
+extern int mem_base_align;
+extern bool use_svm_alloc;
+
+// the allocations can be made and freed from several threads (ie: async and multi device mults)
+static MatMulAlloc *allocs = NULL;
+static pthread_mutex_t allocs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *alloc_host(size_t size, size_t align)
+{
+	// aligned_alloc needs the size to be a multiple of the alignment
+	size = (size + align - 1) / align * align;
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	return aligned_alloc(align, size);
+#endif
+}
+
+void *matmul_alloc(size_t size)
+{
+	size_t align = mem_base_align > MIN_ALLOC_ALIGN ? mem_base_align : MIN_ALLOC_ALIGN;
+	MatMulAlloc *alloc = (MatMulAlloc *)calloc(1, sizeof(MatMulAlloc));
+	alloc->size = size;
+	if (use_svm_alloc && (svm_capabilities & CL_DEVICE_SVM_FINE_GRAIN_BUFFER))
+	{
+		alloc->ptr = clSVMAlloc(context, CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER, size, align);
+		alloc->type = MATMUL_ALLOC_SVM_FINE;
+	}
+	else if (use_svm_alloc && (svm_capabilities & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER))
+	{
+		alloc->ptr = clSVMAlloc(context, CL_MEM_READ_WRITE, size, align);
+		alloc->type = MATMUL_ALLOC_SVM_COARSE;
+		if (alloc->ptr)
+			matmul_alloc_map(alloc);
+	}
+	if (alloc->ptr == NULL)
+	{
+		alloc->ptr = alloc_host(size, align);
+		alloc->type = MATMUL_ALLOC_HOST;
+	}
+	if (alloc->ptr == NULL)
+	{
+		printf("Could not allocate matrix memory of size: %zu\n", size);
+		exit(1);
+	}
+	pthread_mutex_lock(&allocs_lock);
+	alloc->next = allocs;
+	allocs = alloc;
+	pthread_mutex_unlock(&allocs_lock);
+	return alloc->ptr;
+}
+
+void matmul_free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	MatMulAlloc **entry;
+	pthread_mutex_lock(&allocs_lock);
+	for (entry = &allocs; *entry != NULL; entry = &(*entry)->next)
+	{
+		if ((*entry)->ptr == ptr)
+			break;
+	}
+	if (*entry == NULL)
+	{
+		printf("Could not free matrix memory, not allocated with matmul_alloc\n");
+		exit(1);
+	}
+	MatMulAlloc *alloc = *entry;
+	*entry = alloc->next;
+	pthread_mutex_unlock(&allocs_lock);
+	if (alloc->type == MATMUL_ALLOC_HOST)
+	{
+		aligned_free(alloc->ptr);
+	}
+	else
+	{
+		matmul_alloc_unmap(alloc);
+		clFinish(queue);
+		clSVMFree(context, alloc->ptr);
+	}
+	free(alloc);
+}
+
+MatMulAlloc *matmul_find_alloc(const void *ptr, size_t size)
+{
+	uintptr_t begin = (uintptr_t)ptr;
+	MatMulAlloc *found = NULL;
+	pthread_mutex_lock(&allocs_lock);
+	for (MatMulAlloc *alloc = allocs; alloc != NULL; alloc = alloc->next)
+	{
+		uintptr_t alloc_begin = (uintptr_t)alloc->ptr;
+		if (begin >= alloc_begin && begin + size <= alloc_begin + alloc->size)
+		{
+			found = alloc;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&allocs_lock);
+	return found;
+}
+
+void matmul_alloc_unmap(MatMulAlloc *alloc)
+{
+	if (alloc->type != MATMUL_ALLOC_SVM_COARSE || !alloc->mapped)
+		return;
+	cl_int err = clEnqueueSVMUnmap(queue, alloc->ptr, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not unmap svm memory, code: %d\n", err);
+		exit(1);
+	}
+	alloc->mapped = false;
+}
+
+void matmul_alloc_map(MatMulAlloc *alloc)
+{
+	if (alloc->type != MATMUL_ALLOC_SVM_COARSE || alloc->mapped)
+		return;
+	cl_int err = clEnqueueSVMMap(queue, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, alloc->ptr, alloc->size, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not map svm memory, code: %d\n", err);
+		exit(1);
+	}
+	alloc->mapped = true;
+}
@@ -23,8 +23,42 @@ SOFTWARE.
 */
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include "mat_tools.h"
+#include "matmult.h"
+
+#include "cpu_features.h"
+#include "matmult_kernels.h"
+#include "thread_pool.h"
+
+// below this many multiply-adds the gemm runs on the calling thread
+#define GEMM_PARALLEL_MIN_OPS (64LL * 64 * 64)
+// macro tiles per thread to give the work stealing room to balance the load
+#define GEMM_TILES_PER_THREAD 4
+
+typedef struct GemmContext
+{
+	const GemmMicroKernel *ukr;
+	int M;
+	int K;
+	int N;
+	const float *a;
+	int rsa;
+	int csa;
+	const float *b;
+	int rsb;
+	int csb;
+	float *c;
+	int ldc;
+	int tile_n;	 // cols of a macro tile, rows are ukr->mc
+	int tiles_n; // macro tiles along N
+	int pc;		 // first row of b of the current k panel
+	int kc;		 // depth of the current k panel
+	float **ap;	 // packed block of a per worker
+	float *bp;	 // packed panels of b of the current k panel, one per macro tile column, shared by the workers
+} GemmContext;
 
 void mult(int M, int K, int N, float* a, float* b, float* c) {
 	for(int i=0; i<M; i++) {
@@ -49,19 +83,182 @@ void multSwapLoops(int M, int K, int N, float* a, float* b, float* c) {
 
 // convert second matrix to rowmajor by transposing
 void multRowMajor(int M, int K, int N, float* a, float* b, float* c) {
-	float* bt = create(K, N, 0);
+	float* bt = create(N, K, 0);
 	MatTransposeDims transpose_dims;
 	transpose_dims.m = K;
 	transpose_dims.n = N;
-	transpose_dims.tm = K;
-	transpose_dims.tn = N;
-	transpose(transpose_dims, a, bt);
+	transpose_dims.tm = N;
+	transpose_dims.tn = K;
+	transpose(transpose_dims, b, bt);
 	for(int i=0; i<M; i++) {
 		for(int j=0; j<N; j++) {
 			for(int k=0; k<K; k++) {
-				*(c + N*i+j) += *(a + M*i + k) * *(bt + M*j + k);
+				*(c + N*i+j) += *(a + K*i + k) * *(bt + K*j + k);
 			}
 		}
 	}
 	free(bt);
-}
\ No newline at end of file
+}
+
+// pack a mc*kc block of A into slivers of mr rows stored k-major
+// element (i,p) of A is at a[i*rsa + p*csa], partial slivers are zero padded
+static void pack_a(int mc, int kc, int mr, const float *a, int rsa, int csa, float *ap)
+{
+	for (int ir = 0; ir < mc; ir += mr) {
+		int m = mc - ir < mr ? mc - ir : mr;
+		for (int p = 0; p < kc; p++) {
+			for (int i = 0; i < mr; i++) {
+				*ap++ = i < m ? *(a + (ir + i) * rsa + p * csa) : 0.0f;
+			}
+		}
+	}
+}
+
+// pack a kc*nc panel of B into slivers of nr cols stored k-major
+// element (p,j) of B is at b[p*rsb + j*csb], partial slivers are zero padded
+static void pack_b(int kc, int nc, int nr, const float *b, int rsb, int csb, float *bp)
+{
+	for (int jr = 0; jr < nc; jr += nr) {
+		int n = nc - jr < nr ? nc - jr : nr;
+		for (int p = 0; p < kc; p++) {
+			for (int j = 0; j < nr; j++) {
+				*bp++ = j < n ? *(b + p * rsb + (jr + j) * csb) : 0.0f;
+			}
+		}
+	}
+}
+
+// run the micro kernel on a m*n tile of c, partial tiles go through a full size scratch tile
+// the kernel loads c into its accumulators so the sum over k keeps the same order as mult()
+static void micro_tile(const GemmMicroKernel *ukr, int kc, const float *ap, const float *bp,
+					   float *c, int ldc, int m, int n)
+{
+	if (m == ukr->mr && n == ukr->nr) {
+		ukr->kernel(kc, ap, bp, c, ldc);
+		return;
+	}
+	float tile[GEMM_MAX_MR * GEMM_MAX_NR];
+	for (int i = 0; i < m; i++) {
+		memcpy(tile + i * ukr->nr, c + i * ldc, n * sizeof(float));
+	}
+	ukr->kernel(kc, ap, bp, tile, ukr->nr);
+	for (int i = 0; i < m; i++) {
+		memcpy(c + i * ldc, tile + i * ukr->nr, n * sizeof(float));
+	}
+}
+
+// pack the kc*tile_n panel of b of macro tile column task once for all the macro tiles of the column
+static void gemm_pack_b(void *ctx, int task, int worker)
+{
+	GemmContext *g = (GemmContext *)ctx;
+	int jc = task * g->tile_n;
+	int nc = g->N - jc < g->tile_n ? g->N - jc : g->tile_n;
+	pack_b(g->kc, nc, g->ukr->nr, g->b + g->pc * g->rsb + jc * g->csb, g->rsb, g->csb,
+		   g->bp + (size_t)task * g->ukr->kc * g->tile_n);
+}
+
+// compute one mc*tile_n macro tile of c over the current k panel with the packed panel of b
+// the k panels run one after the other so the sum over k is in order and does not depend on the number of threads
+static void gemm_macro_tile(void *ctx, int task, int worker)
+{
+	GemmContext *g = (GemmContext *)ctx;
+	const GemmMicroKernel *ukr = g->ukr;
+	int ic = (task / g->tiles_n) * ukr->mc;
+	int jc = (task % g->tiles_n) * g->tile_n;
+	int mc = g->M - ic < ukr->mc ? g->M - ic : ukr->mc;
+	int nc = g->N - jc < g->tile_n ? g->N - jc : g->tile_n;
+	int kc = g->kc;
+
+	if (g->ap[worker] == NULL) {
+		g->ap[worker] = (float *)aligned_malloc((size_t)ukr->mc * ukr->kc * sizeof(float));
+	}
+	float *ap = g->ap[worker];
+	const float *bp = g->bp + (size_t)(task % g->tiles_n) * ukr->kc * g->tile_n;
+
+	pack_a(mc, kc, ukr->mr, g->a + ic * g->rsa + g->pc * g->csa, g->rsa, g->csa, ap);
+	for (int jr = 0; jr < nc; jr += ukr->nr) {
+		int nr = nc - jr < ukr->nr ? nc - jr : ukr->nr;
+		for (int ir = 0; ir < mc; ir += ukr->mr) {
+			int mr = mc - ir < ukr->mr ? mc - ir : ukr->mr;
+			micro_tile(ukr, kc, ap + ir * kc, bp + jr * kc,
+					   g->c + (ic + ir) * g->ldc + jc + jr, g->ldc, mr, nr);
+		}
+	}
+}
+
+// c[M*N] += a[M*K] * b[K*N] with arbitrary row/col strides for a and b
+// the output is split in macro tiles that run on the thread pool
+static void gemm_blocked(int M, int K, int N,
+						 const float *a, int rsa, int csa,
+						 const float *b, int rsb, int csb,
+						 float *c, int ldc)
+{
+	if (M <= 0 || N <= 0 || K <= 0)
+		return;
+
+	GemmContext g;
+	g.ukr = get_gemm_micro_kernel(get_simd_level());
+	g.M = M;
+	g.K = K;
+	g.N = N;
+	g.a = a;
+	g.rsa = rsa;
+	g.csa = csa;
+	g.b = b;
+	g.rsb = rsb;
+	g.csb = csb;
+	g.c = c;
+	g.ldc = ldc;
+
+	bool parallel = (long long)M * N * K >= GEMM_PARALLEL_MIN_OPS;
+	int threads = parallel ? thread_pool_size() : 1;
+	int tiles_m = (M + g.ukr->mc - 1) / g.ukr->mc;
+	g.tile_n = g.ukr->nc;
+	g.tiles_n = (N + g.tile_n - 1) / g.tile_n;
+	if (threads > 1 && tiles_m * g.tiles_n < GEMM_TILES_PER_THREAD * threads) {
+		// narrower tiles so every thread gets some, but at least a few register tiles wide
+		int tiles_n = (GEMM_TILES_PER_THREAD * threads + tiles_m - 1) / tiles_m;
+		int tile_n = (N + tiles_n - 1) / tiles_n;
+		tile_n = (tile_n + g.ukr->nr - 1) / g.ukr->nr * g.ukr->nr;
+		if (tile_n < 4 * g.ukr->nr)
+			tile_n = 4 * g.ukr->nr;
+		if (tile_n < g.tile_n)
+			g.tile_n = tile_n;
+		g.tiles_n = (N + g.tile_n - 1) / g.tile_n;
+	}
+	int tasks = tiles_m * g.tiles_n;
+
+	// GotoBLAS order: per k panel, each kc*tile_n panel of b is packed once, then the macro tiles
+	// of all the rows of a reuse it and pack only their mc*kc block of a
+	g.ap = (float **)calloc(threads, sizeof(float *));
+	g.bp = (float *)aligned_malloc((size_t)g.tiles_n * g.ukr->kc * g.tile_n * sizeof(float));
+	for (g.pc = 0; g.pc < K; g.pc += g.ukr->kc) {
+		g.kc = K - g.pc < g.ukr->kc ? K - g.pc : g.ukr->kc;
+		if (parallel) {
+			thread_pool_run(g.tiles_n, gemm_pack_b, &g);
+			thread_pool_run(tasks, gemm_macro_tile, &g);
+		} else {
+			for (int i = 0; i < g.tiles_n; i++) {
+				gemm_pack_b(&g, i, 0);
+			}
+			for (int i = 0; i < tasks; i++) {
+				gemm_macro_tile(&g, i, 0);
+			}
+		}
+	}
+	for (int i = 0; i < threads; i++) {
+		aligned_free(g.ap[i]);
+	}
+	free(g.ap);
+	aligned_free(g.bp);
+}
+
+// cache blocked with packed panels
+void multBlocked(int M, int K, int N, float* a, float* b, float* c) {
+	gemm_blocked(M, K, N, a, K, 1, b, N, 1, c, N);
+}
+
+// cache blocked on sub matrices, lda/ldb/ldc are the row strides
+void multBlockedStrided(int M, int K, int N, float* a, int lda, float* b, int ldb, float* c, int ldc) {
+	gemm_blocked(M, K, N, a, lda, 1, b, ldb, 1, c, ldc);
+}
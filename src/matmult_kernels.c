@@ -0,0 +1,292 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// host micro kernels for the blocked multiplication
+// simd kernels are compiled with per function target attributes so no -march flag is needed
+// and the right one is picked at runtime with cpuid, see cpu_features.c
+
+#include "cpu_features.h"
+#include "matmult_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#define TARGET_SSE42
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// scalar 4x8
+static void kernel_scalar_4x8(int kc, const float *ap, const float *bp, float *c, int ldc)
+{
+	float acc[4][8];
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 8; j++)
+		{
+			acc[i][j] = c[i * ldc + j];
+		}
+	}
+	for (int p = 0; p < kc; p++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			float av = ap[i];
+			for (int j = 0; j < 8; j++)
+			{
+				acc[i][j] += av * bp[j];
+			}
+		}
+		ap += 4;
+		bp += 8;
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 8; j++)
+		{
+			c[i * ldc + j] = acc[i][j];
+		}
+	}
+}
+
+#ifdef GEMM_X86
+
+// sse4.2 4x8: 8 accumulators of 4 floats
+#define SSE_LOAD(i)                                  \
+	__m128 c##i##0 = _mm_loadu_ps(c + i * ldc);     \
+	__m128 c##i##1 = _mm_loadu_ps(c + i * ldc + 4);
+#define SSE_MADD(i)                                  \
+	a = _mm_set1_ps(ap[i]);                          \
+	c##i##0 = _mm_add_ps(c##i##0, _mm_mul_ps(a, b0)); \
+	c##i##1 = _mm_add_ps(c##i##1, _mm_mul_ps(a, b1));
+#define SSE_STORE(i)                         \
+	_mm_storeu_ps(c + i * ldc, c##i##0);     \
+	_mm_storeu_ps(c + i * ldc + 4, c##i##1);
+
+TARGET_SSE42 static void kernel_sse42_4x8(int kc, const float *ap, const float *bp, float *c, int ldc)
+{
+	SSE_LOAD(0) SSE_LOAD(1) SSE_LOAD(2) SSE_LOAD(3)
+	__m128 a, b0, b1;
+	for (int p = 0; p < kc; p++)
+	{
+		b0 = _mm_loadu_ps(bp);
+		b1 = _mm_loadu_ps(bp + 4);
+		SSE_MADD(0) SSE_MADD(1) SSE_MADD(2) SSE_MADD(3)
+		ap += 4;
+		bp += 8;
+	}
+	SSE_STORE(0) SSE_STORE(1) SSE_STORE(2) SSE_STORE(3)
+}
+
+// avx2 + fma 6x16: 12 accumulators of 8 floats
+#define AVX2_LOAD(i)                                    \
+	__m256 c##i##0 = _mm256_loadu_ps(c + i * ldc);     \
+	__m256 c##i##1 = _mm256_loadu_ps(c + i * ldc + 8);
+#define AVX2_FMADD(i)                             \
+	a = _mm256_broadcast_ss(ap + i);              \
+	c##i##0 = _mm256_fmadd_ps(a, b0, c##i##0);   \
+	c##i##1 = _mm256_fmadd_ps(a, b1, c##i##1);
+#define AVX2_STORE(i)                           \
+	_mm256_storeu_ps(c + i * ldc, c##i##0);     \
+	_mm256_storeu_ps(c + i * ldc + 8, c##i##1);
+
+TARGET_AVX2 static void kernel_avx2_6x16(int kc, const float *ap, const float *bp, float *c, int ldc)
+{
+	AVX2_LOAD(0) AVX2_LOAD(1) AVX2_LOAD(2) AVX2_LOAD(3) AVX2_LOAD(4) AVX2_LOAD(5)
+	__m256 a, b0, b1;
+	for (int p = 0; p < kc; p++)
+	{
+		b0 = _mm256_loadu_ps(bp);
+		b1 = _mm256_loadu_ps(bp + 8);
+		AVX2_FMADD(0) AVX2_FMADD(1) AVX2_FMADD(2) AVX2_FMADD(3) AVX2_FMADD(4) AVX2_FMADD(5)
+		ap += 6;
+		bp += 16;
+	}
+	AVX2_STORE(0) AVX2_STORE(1) AVX2_STORE(2) AVX2_STORE(3) AVX2_STORE(4) AVX2_STORE(5)
+}
+
+// avx512f 12x32: 24 accumulators of 16 floats
+#define AVX512_LOAD(i)                                   \
+	__m512 c##i##0 = _mm512_loadu_ps(c + i * ldc);      \
+	__m512 c##i##1 = _mm512_loadu_ps(c + i * ldc + 16);
+#define AVX512_FMADD(i)                           \
+	a = _mm512_set1_ps(ap[i]);                    \
+	c##i##0 = _mm512_fmadd_ps(a, b0, c##i##0);   \
+	c##i##1 = _mm512_fmadd_ps(a, b1, c##i##1);
+#define AVX512_STORE(i)                           \
+	_mm512_storeu_ps(c + i * ldc, c##i##0);       \
+	_mm512_storeu_ps(c + i * ldc + 16, c##i##1);
+
+TARGET_AVX512 static void kernel_avx512_12x32(int kc, const float *ap, const float *bp, float *c, int ldc)
+{
+	AVX512_LOAD(0) AVX512_LOAD(1) AVX512_LOAD(2) AVX512_LOAD(3) AVX512_LOAD(4) AVX512_LOAD(5)
+	AVX512_LOAD(6) AVX512_LOAD(7) AVX512_LOAD(8) AVX512_LOAD(9) AVX512_LOAD(10) AVX512_LOAD(11)
+	__m512 a, b0, b1;
+	for (int p = 0; p < kc; p++)
+	{
+		b0 = _mm512_loadu_ps(bp);
+		b1 = _mm512_loadu_ps(bp + 16);
+		AVX512_FMADD(0) AVX512_FMADD(1) AVX512_FMADD(2) AVX512_FMADD(3) AVX512_FMADD(4) AVX512_FMADD(5)
+		AVX512_FMADD(6) AVX512_FMADD(7) AVX512_FMADD(8) AVX512_FMADD(9) AVX512_FMADD(10) AVX512_FMADD(11)
+		ap += 12;
+		bp += 32;
+	}
+	AVX512_STORE(0) AVX512_STORE(1) AVX512_STORE(2) AVX512_STORE(3) AVX512_STORE(4) AVX512_STORE(5)
+	AVX512_STORE(6) AVX512_STORE(7) AVX512_STORE(8) AVX512_STORE(9) AVX512_STORE(10) AVX512_STORE(11)
+}
+
+// 4x4 in-register transpose
+TARGET_SSE42 static void transpose_sse42_4x4(const float *src, int lds, float *dst, int ldd)
+{
+	__m128 r0 = _mm_loadu_ps(src);
+	__m128 r1 = _mm_loadu_ps(src + lds);
+	__m128 r2 = _mm_loadu_ps(src + 2 * lds);
+	__m128 r3 = _mm_loadu_ps(src + 3 * lds);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(dst, r0);
+	_mm_storeu_ps(dst + ldd, r1);
+	_mm_storeu_ps(dst + 2 * ldd, r2);
+	_mm_storeu_ps(dst + 3 * ldd, r3);
+}
+
+// 8x8 in-register transpose: interleave pairs, then quads, then swap 128 bit lanes
+TARGET_AVX static void transpose_avx_8x8(const float *src, int lds, float *dst, int ldd)
+{
+	__m256 r[8], t[8];
+	for (int i = 0; i < 8; i++)
+	{
+		r[i] = _mm256_loadu_ps(src + i * lds);
+	}
+	for (int i = 0; i < 8; i += 2)
+	{
+		t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+	}
+	for (int i = 0; i < 8; i += 4)
+	{
+		r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+		r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xee);
+		r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+		r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xee);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		t[i] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x20);
+		t[i + 4] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x31);
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		_mm256_storeu_ps(dst + i * ldd, t[i]);
+	}
+}
+
+// 16x16 in-register transpose: interleave pairs, then quads, then 128 bit lanes twice
+TARGET_AVX512 static void transpose_avx512_16x16(const float *src, int lds, float *dst, int ldd)
+{
+	__m512 r[16], t[16];
+	for (int i = 0; i < 16; i++)
+	{
+		r[i] = _mm512_loadu_ps(src + i * lds);
+	}
+	for (int i = 0; i < 16; i += 2)
+	{
+		t[i] = _mm512_unpacklo_ps(r[i], r[i + 1]);
+		t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+	}
+	for (int i = 0; i < 16; i += 4)
+	{
+		r[i] = _mm512_shuffle_ps(t[i], t[i + 2], 0x44);
+		r[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], 0xee);
+		r[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+		r[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], 0xee);
+	}
+	for (int i = 0; i < 16; i += 8)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			t[i + j] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0x88);
+			t[i + j + 4] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0xdd);
+		}
+	}
+	for (int j = 0; j < 8; j++)
+	{
+		r[j] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0x88);
+		r[j + 8] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0xdd);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		_mm512_storeu_ps(dst + i * ldd, r[i]);
+	}
+}
+#endif // GEMM_X86
+
+// blocking sizes: a mr*kc sliver of a and a kc*nr sliver of b should fit in L1,
+// the mc*kc block of a in L2 and the kc*nc panel of b in L3
+static const GemmMicroKernel gemm_kernel_scalar = {"scalar 4x8", 4, 8, 96, 256, 4096, kernel_scalar_4x8};
+#ifdef GEMM_X86
+static const GemmMicroKernel gemm_kernel_sse42 = {"sse4.2 4x8", 4, 8, 96, 256, 4096, kernel_sse42_4x8};
+static const GemmMicroKernel gemm_kernel_avx2 = {"avx2+fma 6x16", 6, 16, 96, 256, 4096, kernel_avx2_6x16};
+static const GemmMicroKernel gemm_kernel_avx512 = {"avx512f 12x32", 12, 32, 96, 192, 4096, kernel_avx512_12x32};
+#endif
+
+const GemmMicroKernel *get_gemm_micro_kernel(int simd_level)
+{
+#ifdef GEMM_X86
+	if (simd_level >= SIMD_AVX512)
+		return &gemm_kernel_avx512;
+	if (simd_level >= SIMD_AVX2)
+		return &gemm_kernel_avx2;
+	if (simd_level >= SIMD_SSE42)
+		return &gemm_kernel_sse42;
+#endif
+	return &gemm_kernel_scalar;
+}
+
+#ifdef GEMM_X86
+static const TransposeKernel transpose_kernel_sse42 = {"sse4.2 4x4", 4, transpose_sse42_4x4};
+static const TransposeKernel transpose_kernel_avx = {"avx 8x8", 8, transpose_avx_8x8};
+static const TransposeKernel transpose_kernel_avx512 = {"avx512f 16x16", 16, transpose_avx512_16x16};
+#endif
+
+const TransposeKernel *get_transpose_kernel(int simd_level)
+{
+#ifdef GEMM_X86
+	if (simd_level >= SIMD_AVX512)
+		return &transpose_kernel_avx512;
+	if (simd_level >= SIMD_AVX2)
+		return &transpose_kernel_avx;
+	if (simd_level >= SIMD_SSE42)
+		return &transpose_kernel_sse42;
+#endif
+	return NULL;
+}
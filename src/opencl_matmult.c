@@ -28,13 +28,30 @@ SOFTWARE.
 #include <stdbool.h>
 #include <math.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include <CL/opencl.h>
 #include "opencl_matmult.h"
 #include "opencl_tools.h"
 #include "mat_tools.h"
-
-#define KERNEL_DIR "../kernels/"
+#include "matmult.h"
+#include "matmult_kernels.h"
+#include "cpu_features.h"
+#include "strassen.h"
+#include "kernel_cache.h"
+#include "buffer_pool.h"
+#include "matmul_alloc.h"
+#include "tuning_db.h"
+
+// ints per problem in the grouped gemm descriptor table, see kernel_sgemm.cl
+#define GROUP_DESC_SIZE 8
+
+// how the mult kernel accesses the caller memory
+#define OPERAND_COPY 0	   // pooled device buffer written and read back
+#define OPERAND_HOST_PTR 1 // caller memory wrapped with CL_MEM_USE_HOST_PTR
+#define OPERAND_SVM 2	   // svm from matmul_alloc
 
 int cl_mult(char *kernel_file, char *kernel_name,
 			MatMultDims dims, float *a, float *b, float *c, cl_mem d_at,
@@ -42,7 +59,31 @@ int cl_mult(char *kernel_file, char *kernel_name,
 int cl_transpose(char *kernel_file, char *kernel_name,
 				 MatTransposeDims dims,
 				 float *a, cl_mem d_at);
-void printBuildError(cl_device_id device_id, cl_program program);
+int cl_sgemm(char *kernel_file, char *kernel_name,
+			 MatTranspose transA, MatTranspose transB, int M, int N, int K,
+			 float alpha, const float *a, int lda, long long strideA, const float *b, int ldb, long long strideB,
+			 float beta, float *c, int ldc, long long strideC, int batch,
+			 TileParams *tile_params);
+size_t cl_sgemm_grouped(char *kernel_file, char *kernel_name,
+					 int count, MatMultDims *dims,
+					 float *a, size_t *offsetsA, float *b, size_t *offsetsB, float *c, size_t *offsetsC,
+					 TileParams *tile_params);
+static cl_kernel get_sgemm_kernel(char *kernel_file, char *kernel_name,
+								  MatTranspose transA, MatTranspose transB,
+								  TileParams *tile_params);
+static double enqueue_transpose(char *kernel_file, char *kernel_name,
+								MatTransposeDims dims, cl_mem d_a, cl_mem d_at, int dtype);
+static void enqueue_zero(cl_mem buffer, size_t size);
+static void enqueue_write_rect(const void *src, int src_cols, cl_mem dst, int dst_cols, int rows, int cols,
+							   size_t elem_size);
+static void enqueue_read_rect(cl_mem src, int src_cols, void *dst, int dst_cols, int rows, int cols,
+							  size_t elem_size);
+static double enqueue_mult(char *kernel_file, char *kernel_name,
+						   MatMultDims dims, cl_mem d_a, cl_mem d_b, cl_mem d_c,
+						   bool use_tiling, TileParams *tile_params, int dtype);
+static cl_kernel get_device_sgemm_kernel(cl_device_id device, char *kernel_file, char *kernel_name,
+										 MatTranspose transA, MatTranspose transB,
+										 TileParams *tile_params);
 
 cl_platform_id cpPlatform;	   // OpenCL platform
 cl_device_id device_id = NULL; // device ID
@@ -58,7 +99,12 @@ int default_local_size = 16;
 
 int platform_index = 0;
 int currentDevice = 0;
+// transpose a on the device for the col major mult, the padded mult always transposes on the device
 bool use_cl_transpose = true;
+// host transpose of square matrices in place instead of into a copy, saves the copy but a is modified
+// during the mult (restored before it returns) so it must not be read by other threads meanwhile
+// bool use_inplace_transpose = true;
+bool use_inplace_transpose = false;
 bool validate_transpose_results = false;
 bool print_temp_mat = false;
 
@@ -67,13 +113,101 @@ bool use_optimal_params = false;
 bool use_optimal_local_size = false;
 bool validate_params = true;
 
+// strassen recurses while all dims are larger than the cutoff
+int strassen_cutoff = 1024;
+// strassen leaves run on the padded tiling kernel instead of the host
+bool strassen_use_cl_leaves = true;
+
+// precompile the default kernels on a background thread in init_opencl
+bool use_kernel_warmup = false;
+
+// use the caller memory directly instead of copies when the device shares memory with the host
+// (cpu runtimes, integrated gpus) or the memory is svm from matmul_alloc, off by default so the
+// existing mults keep copying the operands
+// bool use_zero_copy = true;
+bool use_zero_copy = false;
+// matmul_alloc returns svm if the device supports it, aligned host memory otherwise
+bool use_svm_alloc = true;
+bool host_unified_memory = false;
+cl_device_svm_capabilities svm_capabilities = 0;
+int mem_base_align = 0;
+
+// device memory for the panels of openclMatMultStreaming, 0 uses half of the device memory
+size_t streaming_mem_budget = 0;
+// transfers of the streaming mult, overlapped with the kernels on queue
+cl_command_queue io_queue = NULL;
+
+// openclMatMultMultiDevice splits the rows over all devices of the platform (set before init_opencl)
+bool use_multi_device = false;
+// or over the sub devices of the device, ie: the numa nodes of a cpu device
+bool use_sub_devices = false;
+cl_device_id split_devices[MAX_DEVICES];
+cl_command_queue split_queues[MAX_DEVICES];
+int num_split_devices = 0;
+bool split_sub_devices = false;
+// measured throughput of the split devices, the rows are assigned in proportion
+double split_gflops[MAX_DEVICES];
+
+// cost model of MatMultAuto, measured by openclMatMultCalibrate on the first auto mult (or set directly)
+// the rates are fitted over the square calibration sizes so the fixed costs do not skew them
+#define AUTO_CALIBRATION_SIZES 2
+int auto_calibration_sizes[AUTO_CALIBRATION_SIZES] = {128, 512};
+bool auto_calibrated = false;
+double auto_launch_secs = 0;	// fixed cost of a call
+double auto_transfer_rate = 0;	// host to device bytes per sec
+double auto_copy_rate = 0;		// device elements moved per sec by the transpose and the padding
+double auto_kernel_gflops[MatMultPlanTypes]; // per mult type, the host blocked mult included
+double auto_kernel_secs[MatMultPlanTypes];	 // fixed cost of a run per mult type
+
+// tiling params of the tiled kernels from the tuning db written by openclTuneTiling, if tuned for the shape
+bool use_tuning_db = true;
+
+// tuned params for the kernel and shape, the preferred or default params otherwise
+static void set_tiling_params(char *kernel_name, MatMultDims dims, TileParams *tile_params)
+{
+	if (use_tuning_db && tuning_db_lookup(device_name, kernel_name, dims, tile_params))
+	{
+		printf("using tuned tiling params\n");
+		return;
+	}
+	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
+		set_pref_tiling_params(dims, default_local_size, tile_params);
+	else
+		set_default_tiling_params(tile_params);
+}
+
+// kernel of the tiled mult types and its file (can be NULL), NULL for the others
+static char *get_tiled_kernel_name(int mult_type, char **kernel_file)
+{
+	char *file = NULL;
+	char *name = NULL;
+	switch (mult_type)
+	{
+	case MatMultTiling:
+		file = "kernel_matmult_tiling.cl";
+		name = "matmult_block";
+		break;
+	case MatMultTilingColMaj:
+		file = "kernel_matmult_tiling_colmajor.cl";
+		name = "matmult_block_colmajor";
+		break;
+	case MatMultTilingColMajPadded:
+		file = "kernel_matmult_tiling_colmajor_padded.cl";
+		name = "matmult_block_colmajor_padded";
+		break;
+	}
+	if (kernel_file != NULL)
+		*kernel_file = file;
+	return name;
+}
+
 void openclMatMultSimple(MatMultDims dims, float *a, float *b, float *c)
 {
 	time_t start, end;
 
 	start = gettime();
 
-	cl_mult(KERNEL_DIR "kernel_matmult.cl", "matmult_simple",
+	cl_mult("kernel_matmult.cl", "matmult_simple",
 			dims,
 			a, b, c,
 			NULL,
@@ -94,12 +228,9 @@ void openclMatMultBlock(MatMultDims dims, float *a, float *b, float *c)
 	start = gettime();
 
 	TileParams tile_params;
-	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
-		set_pref_tiling_params(dims, default_local_size, &tile_params);
-	else
-		set_default_tiling_params(&tile_params);
+	set_tiling_params("matmult_block", dims, &tile_params);
 
-	cl_mult(KERNEL_DIR "kernel_matmult_tiling.cl", "matmult_block",
+	cl_mult("kernel_matmult_tiling.cl", "matmult_block",
 			dims,
 			a, b, c,
 			NULL,
@@ -121,22 +252,24 @@ void openclMatMultTilingColMajor(MatMultDims dims, float *a, float *b, float *c)
 
 	start = gettime();
 	time_t begint = gettime();
-	float *at = create(dims.k, dims.m, 0);
+	// host copy of the transpose, only needed for the host transpose or for validating
+	float *at = NULL;
 	cl_mem d_at = NULL;
 	MatTransposeDims transpose_dims;
 	transpose_dims.m = dims.m;
 	transpose_dims.n = dims.k;
 	transpose_dims.tm = dims.k;
 	transpose_dims.tn = dims.m;
-	int transpose_size = dims.k * dims.m * sizeof(*at);
+	int transpose_size = dims.k * dims.m * sizeof(float);
 	if (use_cl_transpose)
 	{
-		d_at = clCreateBuffer(context, CL_MEM_WRITE_ONLY, transpose_size, NULL, NULL);
-		cl_transpose(KERNEL_DIR "kernel_transpose.cl", "transpose",
+		d_at = buffer_pool_acquire(context, transpose_size);
+		cl_transpose("kernel_transpose.cl", "transpose",
 					 transpose_dims, a, d_at);
 
 		if (validate_transpose_results || print_temp_mat)
 		{
+			at = create(dims.k, dims.m, 0);
 			// Wait for the command queue to get serviced before reading back results
 			clFinish(queue);
 			// Read the results from the device
@@ -148,10 +281,18 @@ void openclMatMultTilingColMajor(MatMultDims dims, float *a, float *b, float *c)
 			float *at_res = create(dims.k, dims.m, 0);
 			transpose(transpose_dims, a, at_res);
 			assert_mat_equal(dims.k, dims.m, at, at_res);
+			free(at_res);
 		}
 	}
+	else if (use_inplace_transpose && dims.m == dims.k)
+	{
+		// square: transpose the caller's matrix in place and restore it after the mult
+		transpose_inplace(dims.m, a);
+		at = a;
+	}
 	else
 	{
+		at = create(dims.k, dims.m, 0);
 		transpose(transpose_dims, a, at);
 	}
 	time_t endt = gettime();
@@ -162,16 +303,18 @@ void openclMatMultTilingColMajor(MatMultDims dims, float *a, float *b, float *c)
 	}
 
 	TileParams tile_params;
-	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
-		set_pref_tiling_params(dims, default_local_size, &tile_params);
-	else
-		set_default_tiling_params(&tile_params);
+	set_tiling_params("matmult_block_colmajor", dims, &tile_params);
 
-	cl_mult(KERNEL_DIR "kernel_matmult_tiling_colmajor.cl", "matmult_block_colmajor",
+	cl_mult("kernel_matmult_tiling_colmajor.cl", "matmult_block_colmajor",
 			dims,
 			at, b, c, d_at,
 			true, &tile_params);
-	free(at);
+	if (d_at)
+		buffer_pool_release(d_at);
+	if (at == a)
+		transpose_inplace(dims.m, a);
+	else
+		free(at);
 
 	end = gettime();
 	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
@@ -183,7 +326,24 @@ void openclMatMultTilingColMajor(MatMultDims dims, float *a, float *b, float *c)
 		   FLOPs * 1e-9 / dtime);
 }
 
-void openclMatMultTilingColMajorPadded(MatMultDims dims, float *a, float *b, float *c)
+// prints a device matrix for debugging
+static void print_device_matrix(char *name, cl_mem buffer, int rows, int cols)
+{
+	float *mat = create(rows, cols, 0);
+	cl_int err = clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, (size_t)rows * cols * sizeof(float), mat, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not read device matrix, code: %d\n", err);
+		exit(1);
+	}
+	print_matrix(name, mat, rows, cols);
+	free(mat);
+}
+
+// a, b and c are row major with the leading dimensions lda, ldb and ldc
+// a is transposed and padded on the device, b is written and c is read back with rect copies
+// so no padded host matrices are needed
+static void cl_mult_colmajor_padded(MatMultDims dims, float *a, int lda, float *b, int ldb, float *c, int ldc)
 {
 	time_t start, end;
 
@@ -191,106 +351,158 @@ void openclMatMultTilingColMajorPadded(MatMultDims dims, float *a, float *b, flo
 
 	time_t begint = gettime();
 	TileParams tile_params;
-	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
-		set_pref_tiling_params(dims, default_local_size, &tile_params);
-	else
-		set_default_tiling_params(&tile_params);
+	set_tiling_params("matmult_block_colmajor_padded", dims, &tile_params);
 
 	int paddedm = ceil(dims.m / (float)tile_params.BM) * tile_params.BM;
 	int paddedk = ceil(dims.k / (float)tile_params.BK) * tile_params.BK;
 	int paddedn = ceil(dims.n / (float)tile_params.BN) * tile_params.BN;
 
-	float *aTpadded = create(paddedk, paddedm, 0);
-	cl_mem d_at = NULL;
-	int padded_size = dims.k * dims.m * sizeof(*aTpadded);
+	size_t padded_size_a = (size_t)paddedk * paddedm * sizeof(float);
+	size_t padded_size_b = (size_t)paddedk * paddedn * sizeof(float);
+	size_t padded_size_c = (size_t)paddedm * paddedn * sizeof(float);
+	cl_mem d_at = buffer_pool_acquire(context, padded_size_a);
+	// the transpose skips the padding and pooled buffers are not cleared
+	if (paddedm != dims.m || paddedk != dims.k)
+		enqueue_zero(d_at, padded_size_a);
+	// a is always transposed on the device so no host copy of it is made, use_cl_transpose only applies
+	// to the col major mult
 	MatTransposeDims transpose_dims;
 	transpose_dims.m = dims.m;
 	transpose_dims.n = dims.k;
 	transpose_dims.tm = paddedk;
 	transpose_dims.tn = paddedm;
-	if (use_cl_transpose)
-	{
-		d_at = clCreateBuffer(context, CL_MEM_WRITE_ONLY, padded_size, NULL, NULL);
-		cl_transpose(KERNEL_DIR "kernel_transpose.cl", "transpose",
-					 transpose_dims,
-					 a, d_at);
-		if (validate_transpose_results)
-		{
-			// Wait for the command queue to get serviced before reading back results
-			clFinish(queue);
-			// Read the results from the device
-			cl_event event;
-			int read_size = dims.k * dims.m * sizeof(*aTpadded);
-			clEnqueueReadBuffer(queue, d_at, CL_TRUE, 0, read_size, aTpadded, 0, NULL, &event);
-			clWaitForEvents(1, &event);
-			clFinish(queue);
-
-			float *at_res = create(paddedk, paddedm, 0);
-			transpose(transpose_dims, a, at_res);
-			assert_mat_equal(paddedk, paddedm, aTpadded, at_res);
-		}
-	}
-	else
-	{
-		transpose(transpose_dims, a, aTpadded);
-	}
-
-	float *bpadded = NULL;
-	if (paddedk != dims.k || paddedn != dims.n)
-	{
-		bpadded = create(paddedk, paddedn, 0);
-		copy_mat(dims.k, dims.n, b, paddedk, paddedn, bpadded, dims.k, dims.n);
-	}
-	float *cpadded = NULL;
-	if (paddedm != dims.m || paddedn != dims.n)
-	{
-		cpadded = create(paddedm, paddedn, 0);
-	}
-	time_t endt = gettime();
-	double difft = difftime(endt, begint) / 1e9;
-	if (print_temp_mat)
+	cl_mem d_a = buffer_pool_acquire(context, (size_t)dims.m * dims.k * sizeof(float));
+	enqueue_write_rect(a, lda, d_a, dims.k, dims.m, dims.k, sizeof(float));
+	enqueue_transpose("kernel_transpose.cl", "transpose", transpose_dims, d_a, d_at, MatFloat32);
+	buffer_pool_release(d_a);
+	if (validate_transpose_results && lda == dims.k)
 	{
-		print_matrix("ATpadded", aTpadded, paddedk, paddedm);
-		print_matrix("Bpadded", bpadded, paddedk, paddedn);
+		float *aTpadded = create(paddedk, paddedm, 0);
+		// Read the results from the device
+		clEnqueueReadBuffer(queue, d_at, CL_TRUE, 0, padded_size_a, aTpadded, 0, NULL, NULL);
+		float *at_res = create(paddedk, paddedm, 0);
+		transpose(transpose_dims, a, at_res);
+		assert_mat_equal(paddedk, paddedm, aTpadded, at_res);
+		free(at_res);
+		free(aTpadded);
 	}
 
 	MatMultDims padded_dims;
 	padded_dims.m = paddedm;
 	padded_dims.k = paddedk;
 	padded_dims.n = paddedn;
-	cl_mult(KERNEL_DIR "kernel_matmult_tiling_colmajor_padded.cl", "matmult_block_colmajor_padded",
-			padded_dims,
-			aTpadded,
-			bpadded ? bpadded : b,
-			cpadded ? cpadded : c,
-			d_at,
-			true, &tile_params);
 
-	if (cpadded != NULL)
+	// b and c as they are, they can still be used without copies on unified memory
+	if (paddedk == dims.k && paddedn == dims.n && paddedm == dims.m && ldb == dims.n && ldc == dims.n)
+	{
+		time_t endt = gettime();
+		double difft = difftime(endt, begint) / 1e9;
+		printf("total time to transpose and pad (secs): %.3lf\n", difft);
+		if (print_temp_mat)
+			print_device_matrix("ATpadded", d_at, paddedk, paddedm);
+		cl_mult("kernel_matmult_tiling_colmajor_padded.cl", "matmult_block_colmajor_padded",
+				padded_dims,
+				NULL, b, c,
+				d_at,
+				true, &tile_params);
+		buffer_pool_release(d_at);
+	}
+	else
 	{
+		cl_mem d_b = buffer_pool_acquire(context, padded_size_b);
+		if (paddedk != dims.k || paddedn != dims.n)
+			enqueue_zero(d_b, padded_size_b);
+		enqueue_write_rect(b, ldb, d_b, paddedn, dims.k, dims.n, sizeof(float));
+		cl_mem d_c = buffer_pool_acquire(context, padded_size_c);
+		clFinish(queue);
+		time_t endt = gettime();
+		double difft = difftime(endt, begint) / 1e9;
+		printf("total time to transpose and pad (secs): %.3lf\n", difft);
 		if (print_temp_mat)
 		{
-			print_matrix("Cpadded", cpadded, paddedm, paddedn);
+			print_device_matrix("ATpadded", d_at, paddedk, paddedm);
+			print_device_matrix("Bpadded", d_b, paddedk, paddedn);
 		}
-		copy_mat(paddedm, paddedn, cpadded, dims.m, dims.n, c, dims.m, dims.n);
+
+		enqueue_mult("kernel_matmult_tiling_colmajor_padded.cl", "matmult_block_colmajor_padded",
+					 padded_dims, d_at, d_b, d_c,
+					 true, &tile_params, MatFloat32);
+		if (print_temp_mat)
+			print_device_matrix("Cpadded", d_c, paddedm, paddedn);
+		// only the unpadded part is read back
+		enqueue_read_rect(d_c, paddedn, c, ldc, dims.m, dims.n, sizeof(float));
+
+		buffer_pool_release(d_at);
+		buffer_pool_release(d_b);
+		buffer_pool_release(d_c);
 	}
-	free(aTpadded);
-	if (bpadded != NULL)
-		free(bpadded);
-	if (cpadded != NULL)
-		free(cpadded);
 
 	end = gettime();
 
 	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
 	double dtime = difftime(end, start) / 1e9;
 	printf("total estimated FLOPs: %llu\n", FLOPs);
-	printf("total time to transpose and pad (secs): %.3lf\n", difft);
-	printf("total extra mem used: %lld\n", (paddedk * paddedm + paddedk * paddedn + paddedm * paddedn) * sizeof(*a));
+	printf("total extra mem used: %zu\n", padded_size_a + padded_size_b + padded_size_c);
 	printf("total time for openclMatMultTilingColMajorPadded (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
 		   FLOPs * 1e-9 / dtime);
 }
 
+void openclMatMultTilingColMajorPadded(MatMultDims dims, float *a, float *b, float *c)
+{
+	cl_mult_colmajor_padded(dims, a, dims.k, b, dims.n, c, dims.n);
+}
+
+// cpu cache blocked mult, reported the same way as the opencl kernels for benchmarking
+void hostMatMultBlocked(MatMultDims dims, float *a, float *b, float *c)
+{
+	time_t start, end;
+
+	start = gettime();
+
+	printf("host micro kernel: %s\n", get_gemm_micro_kernel(get_simd_level())->name);
+	// multBlocked accumulates so clear the output like the kernels do
+	memset(c, 0, (size_t)dims.m * dims.n * sizeof(*c));
+	multBlocked(dims.m, dims.k, dims.n, a, b, c);
+
+	end = gettime();
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %ld\n", 0L);
+	printf("total time for hostMatMultBlocked (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+// strassen leaf on the padded tiling kernel, the sub matrices are written and read with rect copies
+static void strassen_cl_leaf(int M, int K, int N, float *a, int lda, float *b, int ldb, float *c, int ldc)
+{
+	MatMultDims dims;
+	dims.m = M;
+	dims.k = K;
+	dims.n = N;
+	cl_mult_colmajor_padded(dims, a, lda, b, ldb, c, ldc);
+}
+
+void openclMatMultStrassen(MatMultDims dims, float *a, float *b, float *c)
+{
+	time_t start, end;
+
+	start = gettime();
+
+	size_t temp_mem = multStrassen(dims.m, dims.k, dims.n, a, b, c, strassen_cutoff,
+								   strassen_use_cl_leaves ? strassen_cl_leaf : strassen_host_leaf);
+
+	end = gettime();
+	// classic FLOPs for comparing with the other mult types
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("strassen cutoff: %d, leaves: %s\n", strassen_cutoff, strassen_use_cl_leaves ? "opencl" : "host");
+	printf("total extra mem used: %zu\n", temp_mem);
+	printf("total time for openclMatMultStrassen (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
 void openclMatMult(MatMultDims dims, float *a, float *b, float *c, int mult_type)
 {
 	switch (mult_type)
@@ -307,82 +519,199 @@ void openclMatMult(MatMultDims dims, float *a, float *b, float *c, int mult_type
 	case MatMultTilingColMajPadded:
 		openclMatMultTilingColMajorPadded(dims, a, b, c);
 		break;
+	case MatMultHostBlocked:
+		hostMatMultBlocked(dims, a, b, c);
+		break;
+	case MatMultStrassen:
+		openclMatMultStrassen(dims, a, b, c);
+		break;
+	case MatMultStreaming:
+		openclMatMultStreaming(dims, a, b, c);
+		break;
+	case MatMultMultiDevice:
+		openclMatMultMultiDevice(dims, a, b, c);
+		break;
+	case MatMultAuto:
+		openclMatMultAuto(dims, a, b, c);
+		break;
 	}
 }
 
-// d_at is the transpose buffer if we have transposed the matrix a, otherwise we will use the buffer a
-int cl_mult(char *kernel_file, char *kernel_name,
-			MatMultDims dims, float *a, float *b, float *c, cl_mem d_at,
-			bool use_tiling, TileParams *tile_params)
+void sgemm(MatOrder order, MatTranspose transA, MatTranspose transB, int M, int N, int K,
+		   float alpha, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc)
 {
+	sgemmStridedBatched(order, transA, transB, M, N, K,
+						alpha, A, lda, 0, B, ldb, 0, beta, C, ldc, 0, 1);
+}
 
-	// Device input buffers
-	cl_mem d_a;
-	cl_mem d_b;
-	// Device output buffer
-	cl_mem d_c;
-
-	cl_program program; // program
-	cl_kernel kernel;	// kernel
-
-	cl_int err;
-	size_t local[2], global[2];
+void sgemmStridedBatched(MatOrder order, MatTranspose transA, MatTranspose transB, int M, int N, int K,
+						 float alpha, const float *A, int lda, long long strideA, const float *B, int ldb, long long strideB,
+						 float beta, float *C, int ldc, long long strideC, int batch)
+{
+	time_t start, end;
 
-	FILE *cl_code = fopen(kernel_file, "rb");
-	if (cl_code == NULL)
+	if (order != MatRowMajor && order != MatColMajor)
 	{
-		printf("Could not open mult kernel file: %s\n", kernel_file);
+		printf("sgemm invalid order: %d\n", order);
 		exit(1);
 	}
-	char *source_str = (char *)malloc(MAX_SOURCE_SIZE + 1);
-	memset(source_str, 0, MAX_SOURCE_SIZE + 1);
-	int res = fread(source_str, 1, MAX_SOURCE_SIZE, cl_code);
-	fclose(cl_code);
-
-	int local_size = default_local_size;
-	if (use_optimal_local_size)
+	if ((transA != MatNoTrans && transA != MatTrans) || (transB != MatNoTrans && transB != MatTrans))
+	{
+		printf("sgemm invalid transpose: %d, %d\n", transA, transB);
+		exit(1);
+	}
+	if (M < 0 || N < 0 || K < 0 || batch < 0)
 	{
-		// TODO: this has overhead which is more noticable with small matrixes
-		local_size = get_kernel_max_local_size(context, source_str, kernel_name, device_id, *tile_params);
+		printf("sgemm invalid dims: %d, %d, %d, batch: %d\n", M, N, K, batch);
+		exit(1);
 	}
 
-	if (use_tiling)
+	// a col major C is the row major C^T = op(B)^T * op(A)^T
+	// so we swap the operands and the dims, the leading dimensions stay the same
+	if (order == MatColMajor)
 	{
-		if (use_optimal_params)
-		{
-			set_pref_tiling_params(dims, local_size, tile_params);
-		}
-		add_kernel_defines(source_str, *tile_params);
+		int tmp = M;
+		M = N;
+		N = tmp;
+		const float *tmp_mat = A;
+		A = B;
+		B = tmp_mat;
+		tmp = lda;
+		lda = ldb;
+		ldb = tmp;
+		long long tmp_stride = strideA;
+		strideA = strideB;
+		strideB = tmp_stride;
+		MatTranspose tmp_trans = transA;
+		transA = transB;
+		transB = tmp_trans;
 	}
-	// printf("mult kernel\r\n%s:", source_str);
 
-	// Create the compute program from the source buffer
-	program = clCreateProgramWithSource(context, 1, (const char **)&source_str, NULL, &err);
-	if (err != CL_SUCCESS)
+	int min_lda = transA == MatTrans ? M : K;
+	int min_ldb = transB == MatTrans ? K : N;
+	if (lda < (min_lda > 1 ? min_lda : 1) || ldb < (min_ldb > 1 ? min_ldb : 1) || ldc < (N > 1 ? N : 1))
+	{
+		printf("sgemm invalid leading dimensions: %d, %d, %d\n", lda, ldb, ldc);
+		exit(1);
+	}
+	// a and b can be shared by all batches (stride 0) but the c matrices cannot overlap
+	if (strideA < 0 || strideB < 0 || (batch > 1 && M > 0 && N > 0 && strideC < (long long)(M - 1) * ldc + N))
 	{
-		printf("Could not create mult program, code: %d\n", err);
+		printf("sgemm invalid batch strides: %lld, %lld, %lld\n", strideA, strideB, strideC);
 		exit(1);
 	}
 
-	// Build the program executable
-	err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-	if (err != CL_SUCCESS)
+	if (M == 0 || N == 0 || batch == 0)
+		return;
+
+	start = gettime();
+
+	// nothing to multiply, only scale c
+	if (K == 0 || alpha == 0.0f)
+	{
+		for (int bt = 0; bt < batch; bt++)
+			for (int i = 0; i < M; i++)
+				for (int j = 0; j < N; j++)
+				{
+					float *cij = C + bt * strideC + (size_t)i * ldc + j;
+					*cij = beta == 0.0f ? 0.0f : beta * *cij;
+				}
+		return;
+	}
+
+	TileParams tile_params;
+	MatMultDims dims = {M, K, N};
+	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
+		set_pref_tiling_params(dims, default_local_size, &tile_params);
+	else
+		set_default_tiling_params(&tile_params);
+
+	cl_sgemm("kernel_sgemm.cl", "sgemm_block",
+			 transA, transB, M, N, K,
+			 alpha, A, lda, strideA, B, ldb, strideB,
+			 beta, C, ldc, strideC, batch,
+			 &tile_params);
+
+	end = gettime();
+	unsigned long long FLOPs = (long long)batch * (long long)M * (long long)N * (long long)(2 * K - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %ld\n", 0L);
+	printf("total time for sgemm (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+void openclMatMultStridedBatched(MatMultDims dims, int batch,
+								 float *a, long long strideA, float *b, long long strideB, float *c, long long strideC)
+{
+	sgemmStridedBatched(MatRowMajor, MatNoTrans, MatNoTrans, dims.m, dims.n, dims.k,
+						1.0f, a, dims.k, strideA, b, dims.n, strideB, 0.0f, c, dims.n, strideC, batch);
+}
+
+void openclMatMultGrouped(int count, MatMultDims *dims,
+						  float *a, size_t *offsetsA, float *b, size_t *offsetsB, float *c, size_t *offsetsC)
+{
+	time_t start, end;
+
+	start = gettime();
+
+	// one tiling for the whole group, picked for the largest problem
+	TileParams tile_params;
+	MatMultDims max_dims = {0, 0, 0};
+	unsigned long long FLOPs = 0;
+	for (int i = 0; i < count; i++)
 	{
-		printf("Could not build mult program, code: %d\n", err);
-		if (err == CL_BUILD_PROGRAM_FAILURE)
+		if (dims[i].m < 0 || dims[i].k < 0 || dims[i].n < 0)
 		{
-			printBuildError(device_id, program);
+			printf("grouped mult invalid dims for problem %d: %d, %d, %d\n", i, dims[i].m, dims[i].k, dims[i].n);
+			exit(1);
 		}
-		exit(1);
+		if ((long long)dims[i].m * dims[i].n > (long long)max_dims.m * max_dims.n)
+			max_dims = dims[i];
+		if (dims[i].k > 0)
+			FLOPs += (long long)dims[i].m * (long long)dims[i].n * (long long)(2 * dims[i].k - 1);
 	}
+	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
+		set_pref_tiling_params(max_dims, default_local_size, &tile_params);
+	else
+		set_default_tiling_params(&tile_params);
 
-	// Create the compute kernel in the program we wish to run
-	kernel = clCreateKernel(program, kernel_name, &err);
-	if (err != CL_SUCCESS)
+	size_t extra_mem = cl_sgemm_grouped("kernel_sgemm.cl", "sgemm_grouped",
+										count, dims,
+										a, offsetsA, b, offsetsB, c, offsetsC,
+										&tile_params);
+
+	end = gettime();
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %zu\n", extra_mem);
+	printf("total time for openclMatMultGrouped (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+// kernel for the mult with the local and global sizes, shared by the sync and async mults
+static cl_kernel get_mult_kernel(char *kernel_file, char *kernel_name, MatMultDims dims,
+								 bool use_tiling, TileParams *tile_params, int dtype, size_t *local, size_t *global)
+{
+	cl_kernel kernel;
+	int local_size = default_local_size;
+	char defines[MAX_DEFINES_SIZE] = "";
+	if (use_tiling)
 	{
-		printf("Could not create mult kernel: %s, code: %d\n", kernel_name, err);
-		exit(1);
+		if (use_optimal_local_size)
+			local_size = get_kernel_max_local_size(context, kernel_file, kernel_name, device_id, *tile_params);
+		if (use_optimal_params)
+		{
+			set_pref_tiling_params(dims, local_size, tile_params);
+		}
+		get_kernel_defines(defines, *tile_params);
 	}
+	get_dtype_defines(defines + strlen(defines), dtype);
+
+	// built once per kernel and tiling params, then reused
+	kernel = kernel_cache_get(context, device_id, kernel_file, kernel_name, defines);
+	if (!use_tiling && use_optimal_local_size)
+		local_size = getMaxLocalSize(kernel, device_id, 2);
 
 	int max_local_size = getMaxLocalSize(kernel, device_id, 2);
 	printf("max_local_size: %d\n", max_local_size);
@@ -410,35 +739,125 @@ int cl_mult(char *kernel_file, char *kernel_name,
 		global[0] = dims.m;
 		global[1] = dims.n;
 	}
+	return kernel;
+}
+
+static int get_operand_mode(const void *ptr, size_t size)
+{
+	if (!use_zero_copy)
+		return OPERAND_COPY;
+	MatMulAlloc *alloc = matmul_find_alloc(ptr, size);
+	if (alloc != NULL && alloc->type != MATMUL_ALLOC_HOST)
+		return OPERAND_SVM;
+	// unaligned memory would be copied by the runtime anyway
+	if (host_unified_memory && mem_base_align > 0 && (uintptr_t)ptr % mem_base_align == 0)
+		return OPERAND_HOST_PTR;
+	return OPERAND_COPY;
+}
+
+// NULL for svm which is passed as a pointer
+static cl_mem create_operand(int mode, void *ptr, size_t size, cl_mem_flags flags)
+{
+	cl_int err;
+	if (mode == OPERAND_COPY)
+		return buffer_pool_acquire(context, size);
+	if (mode == OPERAND_SVM)
+	{
+		// coarse grained svm is handed over to the device
+		matmul_alloc_unmap(matmul_find_alloc(ptr, size));
+		return NULL;
+	}
+	cl_mem buffer = clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, size, ptr, &err);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not wrap host memory, code: %d\n", err);
+		exit(1);
+	}
+	return buffer;
+}
+
+static cl_int set_operand_arg(cl_kernel kernel, int param, int mode, cl_mem *buffer, void *ptr)
+{
+	if (mode == OPERAND_SVM)
+		return clSetKernelArgSVMPointer(kernel, param, ptr);
+	return clSetKernelArg(kernel, param, sizeof(cl_mem), (void *)buffer);
+}
+
+static void release_operand(int mode, cl_mem buffer, void *ptr, size_t size)
+{
+	if (mode == OPERAND_COPY)
+		buffer_pool_release(buffer);
+	else if (mode == OPERAND_HOST_PTR)
+		clReleaseMemObject(buffer);
+	else
+		matmul_alloc_map(matmul_find_alloc(ptr, size));
+}
+
+// d_at is the transpose buffer if we have transposed the matrix a, otherwise we will use the buffer a
+int cl_mult(char *kernel_file, char *kernel_name,
+			MatMultDims dims, float *a, float *b, float *c, cl_mem d_at,
+			bool use_tiling, TileParams *tile_params)
+{
+
+	// Device input buffers
+	cl_mem d_a;
+	cl_mem d_b;
+	// Device output buffer
+	cl_mem d_c;
+
+	cl_kernel kernel; // kernel
+
+	cl_int err;
+	size_t local[2], global[2];
+
+	kernel = get_mult_kernel(kernel_file, kernel_name, dims, use_tiling, tile_params, MatFloat32, local, global);
+
+	size_t size_a = dims.m * dims.k * sizeof(*a);
+	size_t size_b = dims.k * dims.n * sizeof(*b);
+	size_t size_c = dims.m * dims.n * sizeof(*c);
+	// the transpose is already on the device
+	int mode_a = d_at ? OPERAND_COPY : get_operand_mode(a, size_a);
+	int mode_b = get_operand_mode(b, size_b);
+	int mode_c = get_operand_mode(c, size_c);
+	printf("operand modes (0: copy, 1: host ptr, 2: svm) a: %d, b: %d, c: %d\n", mode_a, mode_b, mode_c);
 
 	// use the transpose if we have one
 	printf("creating buffers\n");
 	if (d_at)
 		d_a = d_at;
 	else
-		d_a = clCreateBuffer(context, CL_MEM_READ_ONLY, dims.m * dims.k * sizeof(*a), NULL, NULL);
-	d_b = clCreateBuffer(context, CL_MEM_READ_ONLY, dims.k * dims.n * sizeof(*b), NULL, NULL);
-	d_c = clCreateBuffer(context, CL_MEM_WRITE_ONLY, dims.m * dims.n * sizeof(*c), NULL, NULL);
+		d_a = create_operand(mode_a, a, size_a, CL_MEM_READ_ONLY);
+	d_b = create_operand(mode_b, b, size_b, CL_MEM_READ_ONLY);
+	d_c = create_operand(mode_c, c, size_c, CL_MEM_WRITE_ONLY);
 
 	printf("writing buffers\n");
-	cl_event wevent, kevent, revent;
+	cl_event wevent = NULL, kevent, revent = NULL;
 	cl_ulong time_start = 0;
 	cl_ulong time_end = 0;
-	double time_passed_write;
-	// Write our data set into the input array in device memory
-	if (!d_at)
-		err = clEnqueueWriteBuffer(queue, d_a, CL_TRUE, 0, dims.m * dims.k * sizeof(*a), a, 0, NULL, &wevent);
-	err |= clEnqueueWriteBuffer(queue, d_b, CL_TRUE, 0, dims.k * dims.n * sizeof(*b), b, 0, NULL, &wevent);
+	double time_passed_write = 0;
+	// Write our data set into the input array in device memory, zero copy operands need no writes
+	err = CL_SUCCESS;
+	if (!d_at && mode_a == OPERAND_COPY)
+		err = clEnqueueWriteBuffer(queue, d_a, CL_TRUE, 0, size_a, a, 0, NULL, &wevent);
+	if (mode_b == OPERAND_COPY)
+	{
+		if (wevent)
+			clReleaseEvent(wevent);
+		err |= clEnqueueWriteBuffer(queue, d_b, CL_TRUE, 0, size_b, b, 0, NULL, &wevent);
+	}
 	if (err != CL_SUCCESS)
 	{
 		printf("Could not enqueue mult buffers, code: %d\n", err);
 		exit(1);
 	}
-	clWaitForEvents(1, &wevent);
-	err = clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-	err |= clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
-	err |= clReleaseEvent(wevent);
-	time_passed_write = (time_end - time_start) / (double)1e9;
+	if (wevent)
+	{
+		clWaitForEvents(1, &wevent);
+		err = clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+		err |= clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+		err |= clReleaseEvent(wevent);
+		time_passed_write = (time_end - time_start) / (double)1e9;
+	}
 	printf("mult write time (sec): %f\n", time_passed_write);
 
 	printf("setting kernel args\n");
@@ -447,9 +866,9 @@ int cl_mult(char *kernel_file, char *kernel_name,
 	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.m);
 	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.k);
 	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.n);
-	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
-	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
-	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+	err |= set_operand_arg(kernel, param++, mode_a, &d_a, a);
+	err |= set_operand_arg(kernel, param++, mode_b, &d_b, b);
+	err |= set_operand_arg(kernel, param++, mode_c, &d_c, c);
 	if (err != CL_SUCCESS)
 	{
 		printf("Could not set mult kernel args, code: %d\n", err);
@@ -462,6 +881,9 @@ int cl_mult(char *kernel_file, char *kernel_name,
 		printf("Block size for dim K, BK=%d\n", tile_params->BK);
 		printf("Work items for dim M, WIM=%d\n", tile_params->WIM);
 		printf("Work items for dim N, WIN=%d\n", tile_params->WIN);
+		printf("Vector width, VEC=%d\n", tile_params->VEC);
+		printf("Double buffered, DBUF=%d\n", tile_params->DBUF);
+		printf("Local tile padding, LPAD=%d\n", tile_params->LPAD);
 	}
 
 	printf("local_size: %lld:%lld, global_size: %lld:%lld\r\n", local[0], local[1], global[0], global[1]);
@@ -497,198 +919,2191 @@ int cl_mult(char *kernel_file, char *kernel_name,
 	// Wait for the command queue to get serviced before reading back results
 	clFinish(queue);
 
-	// Read the results from the device
-	double time_passed_read;
-	clEnqueueReadBuffer(queue, d_c, CL_TRUE, 0, dims.m * dims.n * sizeof(*c), c, 0, NULL, &revent);
-	clWaitForEvents(1, &revent);
-	err = clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	// Read the results from the device, wrapped host memory is made coherent by mapping it
+	double time_passed_read = 0;
+	err = CL_SUCCESS;
+	if (mode_c == OPERAND_COPY)
+	{
+		err = clEnqueueReadBuffer(queue, d_c, CL_TRUE, 0, size_c, c, 0, NULL, &revent);
+	}
+	else if (mode_c == OPERAND_HOST_PTR)
+	{
+		void *mapped_c = clEnqueueMapBuffer(queue, d_c, CL_TRUE, CL_MAP_READ, 0, size_c, 0, NULL, &revent, &err);
+		if (err == CL_SUCCESS)
+			err = clEnqueueUnmapMemObject(queue, d_c, mapped_c, 0, NULL, NULL);
+	}
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not read mult results, code: %d\n", err);
+		exit(1);
+	}
+	if (revent)
+	{
+		clWaitForEvents(1, &revent);
+		err = clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+		err |= clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+		err |= clReleaseEvent(revent);
+		time_passed_read = (time_end - time_start) / (double)1e9;
+	}
+	printf("mult read time (sec): %f\n", time_passed_read);
+
+	clFinish(queue);
+
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not release mult event, code: %d\n", err);
+		exit(1);
+	}
+
+	// the transpose buffer belongs to the caller, coarse grained svm is mapped back for the host
+	if (!d_at)
+		release_operand(mode_a, d_a, a, size_a);
+	release_operand(mode_b, d_b, b, size_b);
+	release_operand(mode_c, d_c, c, size_c);
+	clFinish(queue);
+
+	fflush(stdout);
+	return 0;
+}
+
+// transposes the device matrix d_a into d_at, the padding of d_at is not written, returns the kernel time (secs)
+static double enqueue_transpose(char *kernel_file, char *kernel_name,
+								MatTransposeDims dims, cl_mem d_a, cl_mem d_at, int dtype)
+{
+	cl_kernel kernel; // kernel
+	cl_int err;
+
+	char defines[MAX_DEFINES_SIZE] = "";
+	get_dtype_defines(defines, dtype);
+	// only the 16 bit types need the defines, the float transpose is shared with the warmup build
+	kernel = kernel_cache_get(context, device_id, kernel_file, kernel_name, dtype == MatFloat32 ? NULL : defines);
+
+	int max_local_size = getMaxLocalSize(kernel, device_id, 2);
+	printf("transpose max_local_size: %d\n", max_local_size);
+	size_t t_local[2] = {max_local_size, max_local_size};
+	size_t t_global[2] = {
+		(size_t)(int)(ceil(dims.m / (float)t_local[0]) * t_local[0]),
+		(size_t)(int)(ceil(dims.n / (float)t_local[1]) * t_local[1])};
+
+	// Set the arguments to our compute kernel
+	int param = 0;
+	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.m);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.n);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.tm);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.tn);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_at);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set kernel args, code: %d\n", err);
+		exit(1);
+	}
+
+	// printf("t_local_size: %ld:%ld, t_global_size: %ld:%ld\r\n", t_local[0], t_local[1], t_global[0], t_global[1]);
+
+	cl_event event;
+	cl_ulong time_start = 0;
+	cl_ulong time_end = 0;
+	double time_passed_kernel;
+
+	// printf("exec kernel: %s\r\n", kernel_name);
+	fflush(stdout);
+	// Execute the kernel over the entire range of the data set
+	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, t_global, t_local, 0, NULL, &event);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not exec transpose kernel, code: %d\n", err);
+		exit(1);
+	}
+
+	clWaitForEvents(1, &event);
+	clFinish(queue);
+	err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not get profiling transpose kernel, code: %d\n", err);
+		exit(1);
+	}
+	// transpose kernel FLOPs estimated:
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n;
+	printf("transpose estimated FLOPs: %llu\n", FLOPs);
+	time_passed_kernel = (time_end - time_start) / (double)1e9;
+	// printf("transpose kernel time (sec): %f\n", time_passed_kernel);
+	printf("transpose GFLOPS: %lf\n", FLOPs * 1e-9 / time_passed_kernel);
+
+	err = clReleaseEvent(event);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not release transpose event, code: %d\n", err);
+		exit(1);
+	}
+	fflush(stdout);
+	return time_passed_kernel;
+}
+
+int cl_transpose(char *kernel_file, char *kernel_name,
+				 MatTransposeDims dims,
+				 float *a, cl_mem d_at)
+{
+	// Device input buffers
+	cl_mem d_a;
+	cl_int err;
+
+	d_a = buffer_pool_acquire(context, dims.m * dims.n * sizeof(*a));
+
+	// Write our data set into the input array in device memory
+	err = clEnqueueWriteBuffer(queue, d_a, CL_FALSE, 0, dims.m * dims.n * sizeof(*a), a, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write transpose buffer, code: %d\n", err);
+		exit(1);
+	}
+
+	enqueue_transpose(kernel_file, kernel_name, dims, d_a, d_at, MatFloat32);
+
+	// the output buffer is released by the caller after the mult
+	buffer_pool_release(d_a);
+	return 0;
+}
+
+// sets the whole buffer to 0
+static void enqueue_zero(cl_mem buffer, size_t size)
+{
+	// 16 bit zeros fill the buffers of all the dtypes
+	cl_ushort zero = 0;
+	cl_int err = clEnqueueFillBuffer(queue, buffer, &zero, sizeof(zero), 0, size, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not fill buffer, code: %d\n", err);
+		exit(1);
+	}
+}
+
+// copies the top left rows * cols of the row major src to the row major dst, the leading dimensions can differ
+static void enqueue_copy_rect(cl_mem src, int src_cols, cl_mem dst, int dst_cols, int rows, int cols)
+{
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {cols * sizeof(float), rows, 1};
+	cl_int err = clEnqueueCopyBufferRect(queue, src, dst, origin, origin, region,
+										 src_cols * sizeof(float), 0, dst_cols * sizeof(float), 0,
+										 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not copy buffer rect, code: %d\n", err);
+		exit(1);
+	}
+}
+
+// writes the host rows * cols with the leading dimension src_cols to the top left of dst
+static void enqueue_write_rect(const void *src, int src_cols, cl_mem dst, int dst_cols, int rows, int cols,
+							   size_t elem_size)
+{
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {cols * elem_size, rows, 1};
+	cl_int err = clEnqueueWriteBufferRect(queue, dst, CL_FALSE, origin, origin, region,
+										  dst_cols * elem_size, 0, src_cols * elem_size, 0, src,
+										  0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write buffer rect, code: %d\n", err);
+		exit(1);
+	}
+}
+
+// reads the top left rows * cols of src to the host matrix with the leading dimension dst_cols
+static void enqueue_read_rect(cl_mem src, int src_cols, void *dst, int dst_cols, int rows, int cols,
+							  size_t elem_size)
+{
+	size_t origin[3] = {0, 0, 0};
+	size_t region[3] = {cols * elem_size, rows, 1};
+	cl_int err = clEnqueueReadBufferRect(queue, src, CL_TRUE, origin, origin, region,
+										 src_cols * elem_size, 0, dst_cols * elem_size, 0, dst,
+										 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not read buffer rect, code: %d\n", err);
+		exit(1);
+	}
+}
+
+// mult of matrices already on the device, d_a is transposed or padded as the kernel expects
+// returns the kernel time (secs)
+static double enqueue_mult(char *kernel_file, char *kernel_name,
+						   MatMultDims dims, cl_mem d_a, cl_mem d_b, cl_mem d_c,
+						   bool use_tiling, TileParams *tile_params, int dtype)
+{
+	size_t local[2], global[2];
+	cl_kernel kernel = get_mult_kernel(kernel_file, kernel_name, dims, use_tiling, tile_params, dtype, local, global);
+
+	int param = 0;
+	cl_int err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.m);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.k);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.n);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set mult kernel args, code: %d\n", err);
+		exit(1);
+	}
+
+	printf("local_size: %lld:%lld, global_size: %lld:%lld\r\n", local[0], local[1], global[0], global[1]);
+	fflush(stdout);
+	cl_event kevent;
+	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &kevent);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not exec mult kernel, code: %d\n", err);
+		exit(1);
+	}
+	clWaitForEvents(1, &kevent);
+	cl_ulong time_start = 0;
+	cl_ulong time_end = 0;
+	err = clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(kevent);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not get profiling mult kernel, code: %d\n", err);
+		exit(1);
+	}
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double time_passed_kernel = (time_end - time_start) / (double)1e9;
+	printf("mult kernel time (sec): %f\n", time_passed_kernel);
+	printf("mult GFLOPS: %lf\n", FLOPs * 1e-9 / time_passed_kernel);
+	return time_passed_kernel;
+}
+
+// device bytes of the double buffered panels
+static size_t streaming_panel_mem(size_t pm, size_t pn, size_t k)
+{
+	return 2 * (pm * k + k * pn + pm * pn) * sizeof(float);
+}
+
+// halves the panel rounded up to the block size, stays a multiple of it
+static size_t halve_panel(size_t panel, int block)
+{
+	return (panel / 2 + block - 1) / block * block;
+}
+
+static void release_event(cl_event *event)
+{
+	if (*event)
+	{
+		clReleaseEvent(*event);
+		*event = NULL;
+	}
+}
+
+// replaces the event, the event is retained so it can be shared
+static void set_event(cl_event *event, cl_event value)
+{
+	release_event(event);
+	clRetainEvent(value);
+	*event = value;
+}
+
+void openclMatMultStreaming(MatMultDims dims, float *a, float *b, float *c)
+{
+	time_t start, end;
+	cl_int err;
+
+	start = gettime();
+
+	TileParams tile_params;
+	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
+		set_pref_tiling_params(dims, default_local_size, &tile_params);
+	else
+		set_default_tiling_params(&tile_params);
+
+	size_t M = dims.m, N = dims.n, K = dims.k;
+	size_t budget = streaming_mem_budget > 0 ? streaming_mem_budget : getGlobalMemSize(device_id) / 2;
+	size_t max_alloc = getMaxMemAllocSize(device_id);
+
+	// start with the whole matrices and halve the larger panel until the panels fit
+	size_t pm = M, pn = N;
+	while (streaming_panel_mem(pm, pn, K) > budget ||
+		   pm * K * sizeof(float) > max_alloc || K * pn * sizeof(float) > max_alloc || pm * pn * sizeof(float) > max_alloc)
+	{
+		if (pm <= (size_t)tile_params.BM && pn <= (size_t)tile_params.BN)
+		{
+			printf("streaming mult panels of %d x %d do not fit in the device memory budget: %zu\n",
+				   tile_params.BM, tile_params.BN, budget);
+			exit(1);
+		}
+		if (pn <= (size_t)tile_params.BN || (pm >= pn && pm > (size_t)tile_params.BM))
+			pm = halve_panel(pm, tile_params.BM);
+		else
+			pn = halve_panel(pn, tile_params.BN);
+	}
+	size_t panels_m = (M + pm - 1) / pm;
+	size_t panels_n = (N + pn - 1) / pn;
+	size_t steps = panels_m * panels_n;
+	printf("streaming mult budget: %zu, panels: %zu x %zu of %zu x %zu, device mem: %zu\n",
+		   budget, panels_m, panels_n, pm, pn, streaming_panel_mem(pm, pn, K));
+
+	cl_kernel kernel = get_sgemm_kernel("kernel_sgemm.cl", "sgemm_block", MatNoTrans, MatNoTrans, &tile_params);
+
+	// transfers go to their own queue so they overlap with the kernels
+	if (io_queue == NULL)
+	{
+		io_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("Could not create io command queue, code: %d\n", err);
+			exit(1);
+		}
+	}
+
+	cl_mem d_a[2], d_b[2], d_c[2];
+	// ready: upload of the slot done, free: the last command using the slot done (kernel for a and b, read for c)
+	cl_event a_ready[2] = {NULL, NULL}, b_ready[2] = {NULL, NULL};
+	cl_event a_free[2] = {NULL, NULL}, b_free[2] = {NULL, NULL}, c_free[2] = {NULL, NULL};
+	// kernel of the c slot, the read of c waits for it
+	cl_event c_ready[2] = {NULL, NULL};
+	for (int slot = 0; slot < 2; slot++)
+	{
+		d_a[slot] = buffer_pool_acquire(context, pm * K * sizeof(float));
+		d_b[slot] = buffer_pool_acquire(context, K * pn * sizeof(float));
+		d_c[slot] = buffer_pool_acquire(context, pm * pn * sizeof(float));
+	}
+
+	// step s multiplies row panel s % panels_m with column panel s / panels_m
+	// a single row panel is uploaded once, column panels are uploaded when the column changes
+	// the uploads run one step ahead and the read of c one step behind the kernels
+	for (size_t step = 0; step <= steps; step++)
+	{
+		// upload the panels of this step
+		if (step < steps)
+		{
+			size_t i = step % panels_m, j = step / panels_m;
+			int a_slot = panels_m == 1 ? 0 : step % 2;
+			int b_slot = j % 2;
+			if (panels_m > 1 || step == 0)
+			{
+				size_t rows = i + 1 < panels_m ? pm : M - i * pm;
+				cl_event event;
+				err = clEnqueueWriteBuffer(io_queue, d_a[a_slot], CL_FALSE, 0, rows * K * sizeof(float), a + i * pm * K,
+										   a_free[a_slot] ? 1 : 0, a_free[a_slot] ? &a_free[a_slot] : NULL, &event);
+				if (err != CL_SUCCESS)
+				{
+					printf("Could not enqueue streaming a panel, code: %d\n", err);
+					exit(1);
+				}
+				release_event(&a_ready[a_slot]);
+				a_ready[a_slot] = event;
+			}
+			if (i == 0)
+			{
+				size_t cols = j + 1 < panels_n ? pn : N - j * pn;
+				size_t buffer_origin[3] = {0, 0, 0};
+				size_t host_origin[3] = {j * pn * sizeof(float), 0, 0};
+				size_t region[3] = {cols * sizeof(float), K, 1};
+				cl_event event;
+				err = clEnqueueWriteBufferRect(io_queue, d_b[b_slot], CL_FALSE, buffer_origin, host_origin, region,
+											   cols * sizeof(float), 0, N * sizeof(float), 0, b,
+											   b_free[b_slot] ? 1 : 0, b_free[b_slot] ? &b_free[b_slot] : NULL, &event);
+				if (err != CL_SUCCESS)
+				{
+					printf("Could not enqueue streaming b panel, code: %d\n", err);
+					exit(1);
+				}
+				release_event(&b_ready[b_slot]);
+				b_ready[b_slot] = event;
+			}
+			clFlush(io_queue);
+
+			int rows = (int)(i + 1 < panels_m ? pm : M - i * pm);
+			int cols = (int)(j + 1 < panels_n ? pn : N - j * pn);
+			int k = (int)K;
+			int c_slot = step % 2;
+			float alpha = 1.0f, beta = 0.0f;
+			cl_long stride = 0;
+			int param = 0;
+			err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&rows);
+			err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&cols);
+			err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&k);
+			err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&alpha);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a[a_slot]);
+			err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&k);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b[b_slot]);
+			err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&cols);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+			err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&beta);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c[c_slot]);
+			err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&cols);
+			err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+			if (err != CL_SUCCESS)
+			{
+				printf("Could not set streaming kernel args, code: %d\n", err);
+				exit(1);
+			}
+
+			size_t local[3], global[3];
+			local[0] = tile_params.BM / tile_params.WIM;
+			local[1] = tile_params.BN / tile_params.WIN;
+			local[2] = 1;
+			global[0] = (size_t)(ceil(rows / (float)tile_params.BM) * tile_params.BM / tile_params.WIM);
+			global[1] = (size_t)(ceil(cols / (float)tile_params.BN) * tile_params.BN / tile_params.WIN);
+			global[2] = 1;
+			// c of the slot is free once the read of two steps ago is done
+			cl_event wait_events[3] = {a_ready[a_slot], b_ready[b_slot], c_free[c_slot]};
+			cl_event kevent;
+			err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global, local, c_free[c_slot] ? 3 : 2, wait_events, &kevent);
+			if (err != CL_SUCCESS)
+			{
+				printf("Could not exec streaming kernel, code: %d\n", err);
+				exit(1);
+			}
+			clFlush(queue);
+			set_event(&a_free[a_slot], kevent);
+			set_event(&b_free[b_slot], kevent);
+			release_event(&c_ready[c_slot]);
+			c_ready[c_slot] = kevent;
+		}
+
+		// read c of the previous step once its kernel is done
+		if (step > 0)
+		{
+			size_t prev = step - 1;
+			size_t i = prev % panels_m, j = prev / panels_m;
+			int c_slot = prev % 2;
+			size_t rows = i + 1 < panels_m ? pm : M - i * pm;
+			size_t cols = j + 1 < panels_n ? pn : N - j * pn;
+			size_t buffer_origin[3] = {0, 0, 0};
+			size_t host_origin[3] = {j * pn * sizeof(float), i * pm, 0};
+			size_t region[3] = {cols * sizeof(float), rows, 1};
+			cl_event event;
+			err = clEnqueueReadBufferRect(io_queue, d_c[c_slot], CL_FALSE, buffer_origin, host_origin, region,
+										  cols * sizeof(float), 0, N * sizeof(float), 0, c, 1, &c_ready[c_slot], &event);
+			if (err != CL_SUCCESS)
+			{
+				printf("Could not enqueue streaming c panel, code: %d\n", err);
+				exit(1);
+			}
+			clFlush(io_queue);
+			release_event(&c_free[c_slot]);
+			c_free[c_slot] = event;
+		}
+	}
+	clFinish(io_queue);
+	clFinish(queue);
+
+	for (int slot = 0; slot < 2; slot++)
+	{
+		release_event(&a_ready[slot]);
+		release_event(&b_ready[slot]);
+		release_event(&a_free[slot]);
+		release_event(&b_free[slot]);
+		release_event(&c_free[slot]);
+		release_event(&c_ready[slot]);
+		buffer_pool_release(d_a[slot]);
+		buffer_pool_release(d_b[slot]);
+		buffer_pool_release(d_c[slot]);
+	}
+
+	end = gettime();
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %ld\n", 0L);
+	printf("total time for openclMatMultStreaming (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+// rows of the mult shared by the split devices, each one takes the next panel when it is done
+typedef struct SplitJob
+{
+	MatMultDims dims;
+	float *a;
+	float *b;
+	float *c;
+	TileParams tile_params;
+	pthread_mutex_t lock;
+	int next_row;
+	int rows_done[MAX_DEVICES];
+	int panels_done[MAX_DEVICES];
+} SplitJob;
+
+typedef struct SplitWorker
+{
+	SplitJob *job;
+	int device;
+} SplitWorker;
+
+// guided: a share of the remaining rows in proportion to the measured throughput of the device,
+// halved so the faster devices can take more when one finishes early, needs the job lock
+static int take_split_rows(SplitJob *job, int device)
+{
+	int remaining = job->dims.m - job->next_row;
+	if (remaining <= 0)
+		return 0;
+	double total_gflops = 0;
+	for (int i = 0; i < num_split_devices; i++)
+		total_gflops += split_gflops[i];
+	int block = job->tile_params.BM;
+	int rows = (int)ceil(remaining * split_gflops[device] / total_gflops / 2);
+	rows = (rows + block - 1) / block * block;
+	return rows < remaining ? rows : remaining;
+}
+
+static void *split_worker_run(void *arg)
+{
+	SplitWorker *worker = (SplitWorker *)arg;
+	SplitJob *job = worker->job;
+	cl_device_id device = split_devices[worker->device];
+	cl_command_queue device_queue = split_queues[worker->device];
+	int K = job->dims.k, N = job->dims.n;
+	cl_int err;
+
+	cl_kernel kernel = get_device_sgemm_kernel(device, "kernel_sgemm.cl", "sgemm_block",
+											   MatNoTrans, MatNoTrans, &job->tile_params);
+	// each device works on its own copy of b
+	cl_mem d_b = buffer_pool_acquire(context, (size_t)K * N * sizeof(float));
+	err = clEnqueueWriteBuffer(device_queue, d_b, CL_TRUE, 0, (size_t)K * N * sizeof(float), job->b, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write split b, code: %d\n", err);
+		exit(1);
+	}
+
+	while (true)
+	{
+		pthread_mutex_lock(&job->lock);
+		int row = job->next_row;
+		int rows = take_split_rows(job, worker->device);
+		job->next_row += rows;
+		pthread_mutex_unlock(&job->lock);
+		if (rows == 0)
+			break;
+
+		time_t start = gettime();
+		cl_mem d_a = buffer_pool_acquire(context, (size_t)rows * K * sizeof(float));
+		cl_mem d_c = buffer_pool_acquire(context, (size_t)rows * N * sizeof(float));
+		err = clEnqueueWriteBuffer(device_queue, d_a, CL_FALSE, 0, (size_t)rows * K * sizeof(float),
+								   job->a + (size_t)row * K, 0, NULL, NULL);
+
+		float alpha = 1.0f, beta = 0.0f;
+		cl_long stride = 0;
+		int param = 0;
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&rows);
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&N);
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&K);
+		err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&alpha);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&K);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&N);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+		err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&beta);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+		err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&N);
+		err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&stride);
+
+		size_t local[3], global[3];
+		local[0] = job->tile_params.BM / job->tile_params.WIM;
+		local[1] = job->tile_params.BN / job->tile_params.WIN;
+		local[2] = 1;
+		global[0] = (size_t)(ceil(rows / (float)job->tile_params.BM) * job->tile_params.BM / job->tile_params.WIM);
+		global[1] = (size_t)(ceil(N / (float)job->tile_params.BN) * job->tile_params.BN / job->tile_params.WIN);
+		global[2] = 1;
+		err |= clEnqueueNDRangeKernel(device_queue, kernel, 3, NULL, global, local, 0, NULL, NULL);
+		err |= clEnqueueReadBuffer(device_queue, d_c, CL_TRUE, 0, (size_t)rows * N * sizeof(float),
+								   job->c + (size_t)row * N, 0, NULL, NULL);
+		if (err != CL_SUCCESS)
+		{
+			printf("Could not exec split mult on device %d, code: %d\n", worker->device, err);
+			exit(1);
+		}
+		buffer_pool_release(d_a);
+		buffer_pool_release(d_c);
+
+		// throughput including the transfers, smoothed over the panels and the calls
+		double dtime = difftime(gettime(), start) / 1e9;
+		double gflops = 2.0 * rows * N * K * 1e-9 / (dtime > 0 ? dtime : 1e-9);
+		pthread_mutex_lock(&job->lock);
+		split_gflops[worker->device] = (split_gflops[worker->device] + gflops) / 2;
+		job->rows_done[worker->device] += rows;
+		job->panels_done[worker->device]++;
+		pthread_mutex_unlock(&job->lock);
+	}
+	buffer_pool_release(d_b);
+	return NULL;
+}
+
+void openclMatMultMultiDevice(MatMultDims dims, float *a, float *b, float *c)
+{
+	time_t start, end;
+
+	start = gettime();
+
+	SplitJob job;
+	job.dims = dims;
+	job.a = a;
+	job.b = b;
+	job.c = c;
+	job.next_row = 0;
+	if (use_optimal_local_size) // we don't have a kernel to get the size so we use the default local size
+		set_pref_tiling_params(dims, default_local_size, &job.tile_params);
+	else
+		set_default_tiling_params(&job.tile_params);
+	pthread_mutex_init(&job.lock, NULL);
+
+	SplitWorker workers[MAX_DEVICES];
+	pthread_t threads[MAX_DEVICES];
+	for (int i = 0; i < num_split_devices; i++)
+	{
+		job.rows_done[i] = 0;
+		job.panels_done[i] = 0;
+		workers[i].job = &job;
+		workers[i].device = i;
+		if (pthread_create(&threads[i], NULL, split_worker_run, &workers[i]) != 0)
+		{
+			printf("Could not start split mult thread\n");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < num_split_devices; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+
+	end = gettime();
+	for (int i = 0; i < num_split_devices; i++)
+	{
+		printf("split device %d rows: %d, panels: %d, GFLOPS: %.2lf\n",
+			   i, job.rows_done[i], job.panels_done[i], split_gflops[i]);
+	}
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %ld\n", 0L);
+	printf("total time for openclMatMultMultiDevice (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+struct MatMultHandle
+{
+	MatMultDims dims;
+	cl_event event; // kernel event
+	cl_mem d_a;
+	cl_mem d_b;
+	cl_mem d_c;
+	float *c;
+	bool done; // result read back and buffers released
+	MatMultCallback callback;
+	void *user_data;
+};
+
+MatMultHandle *openclMatMultAsync(MatMultDims dims, float *a, float *b, float *c, int mult_type,
+								  int num_events, const cl_event *wait_list)
+{
+	char *kernel_file;
+	char *kernel_name;
+	bool use_tiling;
+	TileParams tile_params;
+	size_t local[2], global[2];
+	cl_int err;
+
+	switch (mult_type)
+	{
+	case MatMultSimple:
+		kernel_file = "kernel_matmult.cl";
+		kernel_name = "matmult_simple";
+		use_tiling = false;
+		break;
+	case MatMultTiling:
+		kernel_file = "kernel_matmult_tiling.cl";
+		kernel_name = "matmult_block";
+		use_tiling = true;
+		set_tiling_params(kernel_name, dims, &tile_params);
+		break;
+	default:
+		printf("async mult type not supported: %d\n", mult_type);
+		exit(1);
+	}
+
+	cl_kernel kernel = get_mult_kernel(kernel_file, kernel_name, dims, use_tiling, &tile_params, MatFloat32, local, global);
+
+	MatMultHandle *handle = (MatMultHandle *)calloc(1, sizeof(MatMultHandle));
+	handle->dims = dims;
+	handle->c = c;
+	handle->d_a = buffer_pool_acquire(context, dims.m * dims.k * sizeof(*a));
+	handle->d_b = buffer_pool_acquire(context, dims.k * dims.n * sizeof(*b));
+	handle->d_c = buffer_pool_acquire(context, dims.m * dims.n * sizeof(*c));
+
+	// the writes wait for the caller's events, the kernel for the writes
+	cl_event wevents[2];
+	err = clEnqueueWriteBuffer(queue, handle->d_a, CL_FALSE, 0, dims.m * dims.k * sizeof(*a), a,
+							   num_events, num_events > 0 ? wait_list : NULL, &wevents[0]);
+	err |= clEnqueueWriteBuffer(queue, handle->d_b, CL_FALSE, 0, dims.k * dims.n * sizeof(*b), b,
+								num_events, num_events > 0 ? wait_list : NULL, &wevents[1]);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not enqueue async mult buffers, code: %d\n", err);
+		exit(1);
+	}
+
+	int param = 0;
+	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.m);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.k);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.n);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&handle->d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&handle->d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&handle->d_c);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set async mult kernel args, code: %d\n", err);
+		exit(1);
+	}
+
+	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 2, wevents, &handle->event);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not exec async mult kernel, code: %d\n", err);
+		exit(1);
+	}
+	clReleaseEvent(wevents[0]);
+	clReleaseEvent(wevents[1]);
+	// submit now so the device works while the caller prepares the next request
+	clFlush(queue);
+	return handle;
+}
+
+int openclMatMultWait(MatMultHandle *handle)
+{
+	cl_int err;
+	cl_event revent;
+	cl_ulong time_start = 0;
+	cl_ulong time_end = 0;
+
+	if (handle->done)
+		return 0;
+	MatMultDims dims = handle->dims;
+	err = clEnqueueReadBuffer(queue, handle->d_c, CL_TRUE, 0, dims.m * dims.n * sizeof(float), handle->c,
+							  1, &handle->event, &revent);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not read async mult results, code: %d\n", err);
+		exit(1);
+	}
+	err = clGetEventProfilingInfo(handle->event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(handle->event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	double time_passed_kernel = (time_end - time_start) / (double)1e9;
+	err |= clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
 	err |= clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	double time_passed_read = (time_end - time_start) / (double)1e9;
 	err |= clReleaseEvent(revent);
-	time_passed_read = (time_end - time_start) / (double)1e9;
-	printf("mult read time (sec): %f\n", time_passed_write);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not get profiling async mult, code: %d\n", err);
+		exit(1);
+	}
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	printf("async mult kernel time (sec): %f\n", time_passed_kernel);
+	printf("async mult GFLOPS: %lf\n", FLOPs * 1e-9 / time_passed_kernel);
+	printf("async mult read time (sec): %f\n", time_passed_read);
+
+	buffer_pool_release(handle->d_a);
+	buffer_pool_release(handle->d_b);
+	buffer_pool_release(handle->d_c);
+	handle->done = true;
+	return 0;
+}
+
+bool openclMatMultTest(MatMultHandle *handle)
+{
+	cl_int status;
+	if (handle->done)
+		return true;
+	cl_int err = clGetEventInfo(handle->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not get async mult status, code: %d\n", err);
+		exit(1);
+	}
+	// errors are negative, they are reported by the wait
+	return status == CL_COMPLETE || status < 0;
+}
+
+static void CL_CALLBACK async_mult_complete(cl_event event, cl_int status, void *user_data)
+{
+	MatMultHandle *handle = (MatMultHandle *)user_data;
+	handle->callback(handle, handle->user_data);
+}
+
+void openclMatMultSetCallback(MatMultHandle *handle, MatMultCallback callback, void *user_data)
+{
+	handle->callback = callback;
+	handle->user_data = user_data;
+	cl_int err = clSetEventCallback(handle->event, CL_COMPLETE, async_mult_complete, handle);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set async mult callback, code: %d\n", err);
+		exit(1);
+	}
+}
+
+cl_event openclMatMultGetEvent(MatMultHandle *handle)
+{
+	return handle->event;
+}
+
+void openclMatMultRelease(MatMultHandle *handle)
+{
+	openclMatMultWait(handle);
+	clReleaseEvent(handle->event);
+	free(handle);
+}
+
+// derived form of a handle matrix kept on the device, ie: the transposed a of the col major kernels
+typedef struct MatHandleForm
+{
+	bool transposed;
+	int rows; // stored rows and cols including the padding
+	int cols;
+	cl_mem data;
+	struct MatHandleForm *next;
+} MatHandleForm;
+
+struct MatHandle
+{
+	int rows;
+	int cols;
+	cl_mem data; // row major rows * cols
+	MatHandleForm *forms;
+};
+
+static MatHandle *create_mat_handle(int rows, int cols)
+{
+	if (rows <= 0 || cols <= 0)
+	{
+		printf("invalid mat handle dims: %d, %d\n", rows, cols);
+		exit(1);
+	}
+	MatHandle *handle = (MatHandle *)malloc(sizeof(MatHandle));
+	if (handle == NULL)
+	{
+		printf("Could not allocate mat handle\n");
+		exit(1);
+	}
+	handle->rows = rows;
+	handle->cols = cols;
+	handle->data = buffer_pool_acquire(context, (size_t)rows * cols * sizeof(float));
+	handle->forms = NULL;
+	return handle;
+}
+
+MatHandle *matHandleUpload(int rows, int cols, const float *data)
+{
+	MatHandle *handle = create_mat_handle(rows, cols);
+	cl_int err = clEnqueueWriteBuffer(queue, handle->data, CL_TRUE, 0, (size_t)rows * cols * sizeof(float), data,
+									  0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not upload mat handle, code: %d\n", err);
+		exit(1);
+	}
+	return handle;
+}
+
+void matHandleDownload(MatHandle *handle, float *data)
+{
+	cl_int err = clEnqueueReadBuffer(queue, handle->data, CL_TRUE, 0, (size_t)handle->rows * handle->cols * sizeof(float), data,
+									 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not download mat handle, code: %d\n", err);
+		exit(1);
+	}
+}
+
+int matHandleRows(MatHandle *handle)
+{
+	return handle->rows;
+}
+
+int matHandleCols(MatHandle *handle)
+{
+	return handle->cols;
+}
+
+void matHandleRelease(MatHandle *handle)
+{
+	if (handle == NULL)
+		return;
+	// pending kernels may still read the buffers
+	clFinish(queue);
+	MatHandleForm *form = handle->forms;
+	while (form != NULL)
+	{
+		MatHandleForm *next = form->next;
+		buffer_pool_release(form->data);
+		free(form);
+		form = next;
+	}
+	buffer_pool_release(handle->data);
+	free(handle);
+}
+
+// the matrix (or its transpose) zero padded to rows * cols, built on the first use and kept with the handle
+// new pooled buffer with the handle data transposed and/or zero padded to rows * cols
+static cl_mem create_mat_form(MatHandle *handle, bool transposed, int rows, int cols)
+{
+	size_t size = (size_t)rows * cols * sizeof(float);
+	int data_rows = transposed ? handle->cols : handle->rows;
+	int data_cols = transposed ? handle->rows : handle->cols;
+	cl_mem data = buffer_pool_acquire(context, size);
+	if (rows != data_rows || cols != data_cols)
+		enqueue_zero(data, size);
+	if (transposed)
+	{
+		MatTransposeDims transpose_dims;
+		transpose_dims.m = handle->rows;
+		transpose_dims.n = handle->cols;
+		transpose_dims.tm = rows;
+		transpose_dims.tn = cols;
+		enqueue_transpose("kernel_transpose.cl", "transpose", transpose_dims, handle->data, data, MatFloat32);
+	}
+	else
+	{
+		enqueue_copy_rect(handle->data, handle->cols, data, cols, handle->rows, handle->cols);
+	}
+	return data;
+}
+
+static cl_mem get_mat_handle_form(MatHandle *handle, bool transposed, int rows, int cols)
+{
+	if (!transposed && rows == handle->rows && cols == handle->cols)
+		return handle->data;
+	for (MatHandleForm *form = handle->forms; form != NULL; form = form->next)
+	{
+		if (form->transposed == transposed && form->rows == rows && form->cols == cols)
+			return form->data;
+	}
+
+	MatHandleForm *form = (MatHandleForm *)malloc(sizeof(MatHandleForm));
+	if (form == NULL)
+	{
+		printf("Could not allocate mat handle form\n");
+		exit(1);
+	}
+	form->transposed = transposed;
+	form->rows = rows;
+	form->cols = cols;
+	form->data = create_mat_form(handle, transposed, rows, cols);
+	form->next = handle->forms;
+	handle->forms = form;
+	return form->data;
+}
+
+// tiling used by the handle mults, the same as the host array mults
+static void set_handle_tiling_params(MatMultDims dims, int mult_type, TileParams *tile_params)
+{
+	char *kernel_name = get_tiled_kernel_name(mult_type, NULL);
+	if (kernel_name != NULL)
+		set_tiling_params(kernel_name, dims, tile_params);
+	else
+		set_default_tiling_params(tile_params);
+}
+
+static MatMultDims get_padded_dims(MatMultDims dims, TileParams *tile_params)
+{
+	MatMultDims padded_dims;
+	padded_dims.m = ceil(dims.m / (float)tile_params->BM) * tile_params->BM;
+	padded_dims.k = ceil(dims.k / (float)tile_params->BK) * tile_params->BK;
+	padded_dims.n = ceil(dims.n / (float)tile_params->BN) * tile_params->BN;
+	return padded_dims;
+}
+
+MatHandle *matHandlePack(int rows, int cols, const float *data, int operand, int mult_type)
+{
+	if (operand != MatOperandA && operand != MatOperandB)
+	{
+		printf("invalid mat handle operand: %d\n", operand);
+		exit(1);
+	}
+	MatHandle *handle = matHandleUpload(rows, cols, data);
+	// the other operand is not known yet so the tiling is picked for a square problem,
+	// it is the same for all shapes unless use_optimal_local_size is set, otherwise forms are added on first use
+	MatMultDims dims;
+	dims.m = operand == MatOperandA ? rows : cols;
+	dims.k = operand == MatOperandA ? cols : rows;
+	dims.n = dims.m;
+	TileParams tile_params;
+	set_handle_tiling_params(dims, mult_type, &tile_params);
+	MatMultDims padded_dims = get_padded_dims(dims, &tile_params);
+	if (operand == MatOperandA && mult_type == MatMultTilingColMaj)
+		get_mat_handle_form(handle, true, dims.k, dims.m);
+	else if (operand == MatOperandA && mult_type == MatMultTilingColMajPadded)
+		get_mat_handle_form(handle, true, padded_dims.k, padded_dims.m);
+	else if (operand == MatOperandB && mult_type == MatMultTilingColMajPadded)
+		get_mat_handle_form(handle, false, padded_dims.k, padded_dims.n);
+	clFinish(queue);
+	return handle;
+}
+
+void openclMatMultPackedA(MatHandle *a, int n, float *b, float *c, int mult_type)
+{
+	MatHandle *hb = matHandleUpload(a->cols, n, b);
+	MatHandle *hc = openclMatMultHandle(a, hb, mult_type);
+	matHandleDownload(hc, c);
+	matHandleRelease(hc);
+	matHandleRelease(hb);
+}
+
+void openclMatMultPackedB(int m, float *a, MatHandle *b, float *c, int mult_type)
+{
+	MatHandle *ha = matHandleUpload(m, b->rows, a);
+	MatHandle *hc = openclMatMultHandle(ha, b, mult_type);
+	matHandleDownload(hc, c);
+	matHandleRelease(hc);
+	matHandleRelease(ha);
+}
+
+void openclMatMultDType(MatMultDims dims, void *a, void *b, void *c, int mult_type, int dtype)
+{
+	if (dtype == MatFloat32)
+	{
+		openclMatMult(dims, (float *)a, (float *)b, (float *)c, mult_type);
+		return;
+	}
+	char *kernel_file;
+	char *kernel_name = get_tiled_kernel_name(mult_type, &kernel_file);
+	bool use_tiling = kernel_name != NULL;
+	if (mult_type == MatMultSimple)
+	{
+		kernel_file = "kernel_matmult.cl";
+		kernel_name = "matmult_simple";
+	}
+	else if (!use_tiling)
+	{
+		printf("mult type does not support reduced precision: %d\n", mult_type);
+		exit(1);
+	}
+
+	time_t start, end;
+	start = gettime();
+
+	size_t elem_size = dtype_size(dtype);
+	TileParams tile_params;
+	MatMultDims kernel_dims = dims;
+	// the float tuning of the kernel is shared on purpose, the 16 bit kernels convert on load so the local tiles
+	// and the inner loop are the same as in the float kernel, only the global reads are halved
+	if (use_tiling)
+		set_tiling_params(kernel_name, dims, &tile_params);
+	if (mult_type == MatMultTilingColMajPadded)
+		kernel_dims = get_padded_dims(dims, &tile_params);
+	bool padded = kernel_dims.m != dims.m || kernel_dims.k != dims.k || kernel_dims.n != dims.n;
+
+	size_t size_a = (size_t)dims.m * dims.k * elem_size;
+	size_t size_b = (size_t)kernel_dims.k * kernel_dims.n * elem_size;
+	size_t size_c = (size_t)kernel_dims.m * kernel_dims.n * elem_size;
+	cl_mem d_a = buffer_pool_acquire(context, size_a);
+	cl_mem d_b = buffer_pool_acquire(context, size_b);
+	cl_mem d_c = buffer_pool_acquire(context, size_c);
+	cl_int err = clEnqueueWriteBuffer(queue, d_a, CL_FALSE, 0, size_a, a, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write dtype buffer, code: %d\n", err);
+		exit(1);
+	}
+	// the pooled buffers are not cleared, the padding of b and of the transposed a is zeroed
+	if (padded)
+		enqueue_zero(d_b, size_b);
+	enqueue_write_rect(b, dims.n, d_b, kernel_dims.n, dims.k, dims.n, elem_size);
+
+	// the transpose copies the 16 bit elements as they are
+	cl_mem d_at = NULL;
+	size_t size_at = 0;
+	if (mult_type == MatMultTilingColMaj || mult_type == MatMultTilingColMajPadded)
+	{
+		size_at = (size_t)kernel_dims.k * kernel_dims.m * elem_size;
+		d_at = buffer_pool_acquire(context, size_at);
+		if (padded)
+			enqueue_zero(d_at, size_at);
+		MatTransposeDims transpose_dims;
+		transpose_dims.m = dims.m;
+		transpose_dims.n = dims.k;
+		transpose_dims.tm = kernel_dims.k;
+		transpose_dims.tn = kernel_dims.m;
+		enqueue_transpose("kernel_transpose.cl", "transpose", transpose_dims, d_a, d_at, dtype);
+	}
+
+	enqueue_mult(kernel_file, kernel_name, kernel_dims, d_at != NULL ? d_at : d_a, d_b, d_c,
+				 use_tiling, &tile_params, dtype);
+	enqueue_read_rect(d_c, kernel_dims.n, c, dims.n, dims.m, dims.n, elem_size);
+
+	if (d_at != NULL)
+		buffer_pool_release(d_at);
+	buffer_pool_release(d_a);
+	buffer_pool_release(d_b);
+	buffer_pool_release(d_c);
+
+	end = gettime();
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total extra mem used: %zu\n", size_at + (padded ? size_b + size_c : 0));
+	printf("total time for openclMatMultDType (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+}
+
+// uploads the host floats to a new pooled buffer of size floats, the rest of it is 1
+static cl_mem create_quant_scales(const float *scales, int count, int size)
+{
+	float *padded = malloc(size * sizeof(float));
+	for (int i = 0; i < size; i++)
+		padded[i] = scales != NULL && i < count ? scales[i] : 1.0f;
+	cl_mem buffer = buffer_pool_acquire(context, size * sizeof(float));
+	cl_int err = clEnqueueWriteBuffer(queue, buffer, CL_TRUE, 0, size * sizeof(float), padded, 0, NULL, NULL);
+	free(padded);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write scales buffer, code: %d\n", err);
+		exit(1);
+	}
+	return buffer;
+}
+
+void openclMatMultInt8(MatMultDims dims, const int8_t *a, const int8_t *b, void *c, MatQuantParams *params, int out_type)
+{
+	if (out_type != MatQuantInt32 && out_type != MatQuantFloat && out_type != MatQuantInt8)
+	{
+		printf("invalid int8 mult out type: %d\n", out_type);
+		exit(1);
+	}
+	char *kernel_file = "kernel_matmult_tiling_int8.cl";
+	char *kernel_name = "matmult_block_int8";
+
+	time_t start, end;
+	start = gettime();
+
+	// BK counts groups of 4 int8 packed in a uint so k is padded to 4 * BK
+	TileParams tile_params;
+	set_tiling_params(kernel_name, dims, &tile_params);
+	MatMultDims padded_dims = get_padded_dims(dims, &tile_params);
+	padded_dims.k = ceil(dims.k / (float)(4 * tile_params.BK)) * 4 * tile_params.BK;
+	if (validate_params)
+		validate_tiling(tile_params, default_local_size);
+
+	// a is packed along its rows as it is, b is interleaved so the 4 values of rows 4k..4k+3 of a column
+	// are consecutive, the sums of the rows of a and the columns of b apply the zero points in the kernel
+	int *rowsum_a = calloc(padded_dims.m, sizeof(int));
+	int *colsum_b = calloc(padded_dims.n, sizeof(int));
+	int8_t *packed_b = calloc((size_t)padded_dims.k * padded_dims.n, sizeof(int8_t));
+	for (int i = 0; i < dims.m; i++)
+		for (int j = 0; j < dims.k; j++)
+			rowsum_a[i] += a[(size_t)i * dims.k + j];
+	for (int i = 0; i < dims.k; i++)
+		for (int j = 0; j < dims.n; j++)
+		{
+			int8_t value = b[(size_t)i * dims.n + j];
+			packed_b[((size_t)(i / 4) * padded_dims.n + j) * 4 + i % 4] = value;
+			colsum_b[j] += value;
+		}
+
+	size_t out_size = out_type == MatQuantInt8 ? sizeof(int8_t) : sizeof(int);
+	size_t size_a = (size_t)padded_dims.m * padded_dims.k;
+	size_t size_b = (size_t)padded_dims.k * padded_dims.n;
+	size_t size_c = (size_t)padded_dims.m * padded_dims.n * out_size;
+	cl_mem d_a = buffer_pool_acquire(context, size_a);
+	cl_mem d_b = buffer_pool_acquire(context, size_b);
+	cl_mem d_c = buffer_pool_acquire(context, size_c);
+	cl_mem d_rowsum_a = buffer_pool_acquire(context, padded_dims.m * sizeof(int));
+	cl_mem d_colsum_b = buffer_pool_acquire(context, padded_dims.n * sizeof(int));
+	if (padded_dims.m != dims.m || padded_dims.k != dims.k)
+		enqueue_zero(d_a, size_a);
+	enqueue_write_rect(a, dims.k, d_a, padded_dims.k, dims.m, dims.k, sizeof(int8_t));
+	cl_int err = clEnqueueWriteBuffer(queue, d_b, CL_FALSE, 0, size_b, packed_b, 0, NULL, NULL);
+	err |= clEnqueueWriteBuffer(queue, d_rowsum_a, CL_FALSE, 0, padded_dims.m * sizeof(int), rowsum_a, 0, NULL, NULL);
+	err |= clEnqueueWriteBuffer(queue, d_colsum_b, CL_FALSE, 0, padded_dims.n * sizeof(int), colsum_b, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not write int8 buffers, code: %d\n", err);
+		exit(1);
+	}
+	cl_mem d_scales_a = create_quant_scales(params->a_scales, dims.m, padded_dims.m);
+	cl_mem d_scales_b = create_quant_scales(params->b_scales, dims.n, padded_dims.n);
+
+	char defines[MAX_DEFINES_SIZE];
+	get_kernel_defines(defines, tile_params);
+	sprintf(defines + strlen(defines), "#define OUT_MODE %d\r\n", out_type);
+	cl_kernel kernel = kernel_cache_get(context, device_id, kernel_file, kernel_name, defines);
+
+	int packed_k = padded_dims.k / 4;
+	int param = 0;
+	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&padded_dims.m);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&packed_k);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&padded_dims.n);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.k);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_rowsum_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_colsum_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_scales_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_scales_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&params->a_zero);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&params->b_zero);
+	err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&params->c_scale);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&params->c_zero);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set int8 mult kernel args, code: %d\n", err);
+		exit(1);
+	}
+
+	size_t local[2], global[2];
+	local[0] = tile_params.BM / tile_params.WIM;
+	local[1] = tile_params.BN / tile_params.WIN;
+	global[0] = padded_dims.m / tile_params.WIM;
+	global[1] = padded_dims.n / tile_params.WIN;
+	printf("local_size: %lld:%lld, global_size: %lld:%lld\r\n", local[0], local[1], global[0], global[1]);
+	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, NULL);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not exec int8 mult kernel, code: %d\n", err);
+		exit(1);
+	}
+	enqueue_read_rect(d_c, padded_dims.n, c, dims.n, dims.m, dims.n, out_size);
+
+	buffer_pool_release(d_a);
+	buffer_pool_release(d_b);
+	buffer_pool_release(d_c);
+	buffer_pool_release(d_rowsum_a);
+	buffer_pool_release(d_colsum_b);
+	buffer_pool_release(d_scales_a);
+	buffer_pool_release(d_scales_b);
+	free(packed_b);
+	free(rowsum_a);
+	free(colsum_b);
+
+	end = gettime();
+	unsigned long long OPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated OPs: %llu\n", OPs);
+	printf("total time for openclMatMultInt8 (secs): %.3lf, total GOPS: %.2lf\n", dtime, OPs * 1e-9 / dtime);
+}
+
+MatHandle *openclMatMultHandle(MatHandle *a, MatHandle *b, int mult_type)
+{
+	time_t start, end;
+
+	if (a->cols != b->rows)
+	{
+		printf("mat handle mult dims mismatch: %d * %d, %d * %d\n", a->rows, a->cols, b->rows, b->cols);
+		exit(1);
+	}
+	start = gettime();
+
+	MatMultDims dims = {a->rows, a->cols, b->cols};
+	MatHandle *c = create_mat_handle(dims.m, dims.n);
+
+	TileParams tile_params;
+	set_handle_tiling_params(dims, mult_type, &tile_params);
+
+	switch (mult_type)
+	{
+	case MatMultSimple:
+		enqueue_mult("kernel_matmult.cl", "matmult_simple",
+					 dims, a->data, b->data, c->data,
+					 false, NULL, MatFloat32);
+		break;
+	case MatMultTiling:
+		enqueue_mult("kernel_matmult_tiling.cl", "matmult_block",
+					 dims, a->data, b->data, c->data,
+					 true, &tile_params, MatFloat32);
+		break;
+	case MatMultTilingColMaj:
+		enqueue_mult("kernel_matmult_tiling_colmajor.cl", "matmult_block_colmajor",
+					 dims, get_mat_handle_form(a, true, dims.k, dims.m), b->data, c->data,
+					 true, &tile_params, MatFloat32);
+		break;
+	case MatMultTilingColMajPadded:
+	{
+		MatMultDims padded_dims = get_padded_dims(dims, &tile_params);
+		cl_mem d_at = get_mat_handle_form(a, true, padded_dims.k, padded_dims.m);
+		cl_mem d_b = get_mat_handle_form(b, false, padded_dims.k, padded_dims.n);
+		// the padded c is only a scratch buffer, the result handle is not padded
+		cl_mem d_c = c->data;
+		if (padded_dims.m != dims.m || padded_dims.n != dims.n)
+			d_c = buffer_pool_acquire(context, (size_t)padded_dims.m * padded_dims.n * sizeof(float));
+		enqueue_mult("kernel_matmult_tiling_colmajor_padded.cl", "matmult_block_colmajor_padded",
+					 padded_dims, d_at, d_b, d_c,
+					 true, &tile_params, MatFloat32);
+		if (d_c != c->data)
+		{
+			enqueue_copy_rect(d_c, padded_dims.n, c->data, dims.n, dims.m, dims.n);
+			clFinish(queue);
+			buffer_pool_release(d_c);
+		}
+		break;
+	}
+	default:
+		printf("mat handle mult type not supported: %d\n", mult_type);
+		exit(1);
+	}
+	clFinish(queue);
+
+	end = gettime();
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double dtime = difftime(end, start) / 1e9;
+	printf("total estimated FLOPs: %llu\n", FLOPs);
+	printf("total time for openclMatMultHandle (secs): %.3lf, total GFLOPS: %.2lf\n", dtime,
+		   FLOPs * 1e-9 / dtime);
+	return c;
+}
+
+// candidate sizes of the autotuner, filtered with is_valid_tiling and the device limits
+static const int tune_block_sizes[] = {8, 16, 32, 64, 128};
+static const int tune_k_block_sizes[] = {4, 8, 16, 32};
+static const int tune_item_sizes[] = {1, 2, 4, 8};
+static const int tune_vec_sizes[] = {1, 2, 4, 8};
+static const int tune_dbufs[] = {0, 1};
+static const int tune_lpads[] = {0, 1};
+#define TUNE_REPEATS 3
+
+// the candidates are timed on float operands
+static void get_tuning_defines(char *defines, TileParams tile_params)
+{
+	get_kernel_defines(defines, tile_params);
+	get_dtype_defines(defines + strlen(defines), MatFloat32);
+}
+
+// best kernel time (secs) of the runs, negative if the tiling can not run or gives wrong results
+static double time_tiling(cl_kernel kernel, TileParams tile_params,
+						  MatMultDims kernel_dims, cl_mem d_a, cl_mem d_b, cl_mem d_c,
+						  MatMultDims dims, float *c, float *res_mat)
+{
+	size_t local[2], global[2];
+	local[0] = tile_params.BM / tile_params.WIM;
+	local[1] = tile_params.BN / tile_params.WIN;
+	if (local[0] * local[1] > (size_t)getWorkgroupSize(kernel, device_id))
+		return -1;
+	global[0] = (size_t)(ceil(kernel_dims.m / (float)tile_params.BM) * tile_params.BM / tile_params.WIM);
+	global[1] = (size_t)(ceil(kernel_dims.n / (float)tile_params.BN) * tile_params.BN / tile_params.WIN);
+
+	int param = 0;
+	cl_int err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&kernel_dims.m);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&kernel_dims.k);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&kernel_dims.n);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not set tuning kernel args, code: %d\n", err);
+		exit(1);
+	}
+
+	double best = -1;
+	for (int i = 0; i < TUNE_REPEATS; i++)
+	{
+		cl_event event;
+		err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &event);
+		if (err != CL_SUCCESS)
+			return -1;
+		clWaitForEvents(1, &event);
+		cl_ulong time_start = 0;
+		cl_ulong time_end = 0;
+		err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+		err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+		clReleaseEvent(event);
+		if (err != CL_SUCCESS)
+		{
+			printf("Could not get profiling tuning kernel, code: %d\n", err);
+			exit(1);
+		}
+		double time_passed = (time_end - time_start) / (double)1e9;
+		if (best < 0 || time_passed < best)
+			best = time_passed;
+	}
+
+	// some tilings do not cover all shapes, they are skipped
+	enqueue_read_rect(d_c, kernel_dims.n, c, dims.n, dims.m, dims.n, sizeof(float));
+	if (memcmp(c, res_mat, (size_t)dims.m * dims.n * sizeof(float)) != 0)
+		return -1;
+	return best;
+}
+
+// operands of the tuner and the tiling benchmark
+typedef struct TuneOperands
+{
+	float *a;
+	float *b;
+	float *c;
+	float *res_mat;
+	MatHandle *ha;
+	MatHandle *hb;
+} TuneOperands;
+
+static void create_tune_operands(MatMultDims dims, TuneOperands *ops)
+{
+	// small integers so the sums are exact and the results can be compared directly
+	ops->a = create(dims.m, dims.k, 0);
+	ops->b = create(dims.k, dims.n, 0);
+	ops->c = create(dims.m, dims.n, 0);
+	ops->res_mat = create(dims.m, dims.n, 0);
+	for (long i = 0; i < (long)dims.m * dims.k; i++)
+		ops->a[i] = (float)(i % 7 - 3);
+	for (long i = 0; i < (long)dims.k * dims.n; i++)
+		ops->b[i] = (float)(i % 5 - 2);
+	multBlocked(dims.m, dims.k, dims.n, ops->a, ops->b, ops->res_mat);
+	ops->ha = matHandleUpload(dims.m, dims.k, ops->a);
+	ops->hb = matHandleUpload(dims.k, dims.n, ops->b);
+}
+
+static void release_tune_operands(TuneOperands *ops)
+{
+	matHandleRelease(ops->hb);
+	matHandleRelease(ops->ha);
+	free(ops->a);
+	free(ops->b);
+	free(ops->c);
+	free(ops->res_mat);
+}
+
+// checks the tiling against the device limits and times it, negative if it can not run on dims
+// the candidate is built outside of the kernel cache so only the tiling that is used later is kept
+static double time_tiling_params(char *kernel_file, char *kernel_name, int mult_type, TileParams tile_params,
+								 MatMultDims dims, TuneOperands *ops)
+{
+	// the local size is checked against the kernel once it is built
+	int local_size = use_optimal_local_size ? INT_MAX : default_local_size;
+	if (!is_valid_tiling(tile_params, local_size))
+		return -1;
+	long local_mem = (long)(tile_params.BM + tile_params.BN + 2 * tile_params.LPAD) * tile_params.BK * (1 + tile_params.DBUF);
+	if (local_mem * (long)sizeof(float) > max_shared_mem)
+		return -1;
+
+	char defines[MAX_DEFINES_SIZE];
+	get_tuning_defines(defines, tile_params);
+	cl_program program;
+	cl_kernel kernel = kernel_cache_build(context, device_id, kernel_file, kernel_name, defines, &program);
+	if (kernel == NULL)
+		return -1;
+	if (use_optimal_local_size && !is_valid_tiling(tile_params, getMaxLocalSize(kernel, device_id, 2)))
+	{
+		clReleaseKernel(kernel);
+		clReleaseProgram(program);
+		return -1;
+	}
 
-	clFinish(queue);
+	MatMultDims kernel_dims = dims;
+	cl_mem d_a = ops->ha->data;
+	cl_mem d_b = ops->hb->data;
+	// the transposed a is the same for all candidates and kept on the handle, the padded forms
+	// depend on the blocks so they go to pooled scratch buffers released after the candidate
+	cl_mem d_a_padded = NULL, d_b_padded = NULL;
+	if (mult_type == MatMultTilingColMaj)
+	{
+		d_a = get_mat_handle_form(ops->ha, true, dims.k, dims.m);
+	}
+	else if (mult_type == MatMultTilingColMajPadded)
+	{
+		kernel_dims = get_padded_dims(dims, &tile_params);
+		d_a = d_a_padded = create_mat_form(ops->ha, true, kernel_dims.k, kernel_dims.m);
+		if (kernel_dims.k != dims.k || kernel_dims.n != dims.n)
+			d_b = d_b_padded = create_mat_form(ops->hb, false, kernel_dims.k, kernel_dims.n);
+	}
+	cl_mem d_c = buffer_pool_acquire(context, (size_t)kernel_dims.m * kernel_dims.n * sizeof(float));
+	double time_passed = time_tiling(kernel, tile_params,
+									 kernel_dims, d_a, d_b, d_c, dims, ops->c, ops->res_mat);
+	buffer_pool_release(d_c);
+	if (d_a_padded != NULL)
+		buffer_pool_release(d_a_padded);
+	if (d_b_padded != NULL)
+		buffer_pool_release(d_b_padded);
+	clReleaseKernel(kernel);
+	clReleaseProgram(program);
+	return time_passed;
+}
 
-	if (err != CL_SUCCESS)
+TileParams openclTuneTiling(int mult_type, MatMultDims dims)
+{
+	char *kernel_file;
+	char *kernel_name = get_tiled_kernel_name(mult_type, &kernel_file);
+	if (kernel_name == NULL)
 	{
-		printf("Could not release mult event, code: %d\n", err);
+		printf("mult type can not be tuned: %d\n", mult_type);
 		exit(1);
 	}
-
-	err = clReleaseMemObject(d_a);
-	err |= clReleaseMemObject(d_b);
-	err |= clReleaseMemObject(d_c);
-	if (err != CL_SUCCESS)
+	printf("tuning %s for %d, %d, %d\n", kernel_name, dims.m, dims.k, dims.n);
+
+	TuneOperands ops;
+	create_tune_operands(dims, &ops);
+
+	TileParams best_params;
+	double best_time = -1;
+	int candidates = 0;
+	int bm_count = sizeof(tune_block_sizes) / sizeof(*tune_block_sizes);
+	int bk_count = sizeof(tune_k_block_sizes) / sizeof(*tune_k_block_sizes);
+	int wi_count = sizeof(tune_item_sizes) / sizeof(*tune_item_sizes);
+	int vec_count = sizeof(tune_vec_sizes) / sizeof(*tune_vec_sizes);
+	int dbuf_count = sizeof(tune_dbufs) / sizeof(*tune_dbufs);
+	int lpad_count = sizeof(tune_lpads) / sizeof(*tune_lpads);
+	for (int im = 0; im < bm_count; im++)
+		for (int in = 0; in < bm_count; in++)
+			for (int ik = 0; ik < bk_count; ik++)
+				for (int iwm = 0; iwm < wi_count; iwm++)
+					for (int iwn = 0; iwn < wi_count; iwn++)
+						for (int iv = 0; iv < vec_count * dbuf_count * lpad_count; iv++)
+						{
+							TileParams tile_params;
+							tile_params.BM = tune_block_sizes[im];
+							tile_params.BN = tune_block_sizes[in];
+							tile_params.BK = tune_k_block_sizes[ik];
+							tile_params.WIM = tune_item_sizes[iwm];
+							tile_params.WIN = tune_item_sizes[iwn];
+							tile_params.VEC = tune_vec_sizes[iv % vec_count];
+							tile_params.DBUF = tune_dbufs[iv / vec_count % dbuf_count];
+							tile_params.LPAD = tune_lpads[iv / (vec_count * dbuf_count)];
+							// blocks much larger than the matrix only compute padding
+							if (tile_params.BM / 2 >= dims.m || tile_params.BN / 2 >= dims.n || tile_params.BK / 2 >= dims.k)
+								continue;
+							if (!is_valid_tiling(tile_params, INT_MAX))
+								continue;
+							double time_passed = time_tiling_params(kernel_file, kernel_name, mult_type, tile_params, dims, &ops);
+							candidates++;
+							if (time_passed < 0)
+								continue;
+							printf("BM=%d BN=%d BK=%d WIM=%d WIN=%d VEC=%d DBUF=%d LPAD=%d: %.6lf secs\n",
+								   tile_params.BM, tile_params.BN, tile_params.BK, tile_params.WIM, tile_params.WIN,
+								   tile_params.VEC, tile_params.DBUF, tile_params.LPAD, time_passed);
+							if (best_time < 0 || time_passed < best_time)
+							{
+								best_time = time_passed;
+								best_params = tile_params;
+							}
+						}
+	release_tune_operands(&ops);
+
+	if (best_time < 0)
 	{
-		printf("Could not release mult resources, code: %d\n", err);
+		printf("no valid tiling found for %s, candidates: %d\n", kernel_name, candidates);
 		exit(1);
 	}
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	double gflops = FLOPs * 1e-9 / best_time;
+	printf("best tiling of %d candidates: BM=%d BN=%d BK=%d WIM=%d WIN=%d VEC=%d DBUF=%d LPAD=%d, GFLOPS: %.2lf\n", candidates,
+		   best_params.BM, best_params.BN, best_params.BK, best_params.WIM, best_params.WIN,
+		   best_params.VEC, best_params.DBUF, best_params.LPAD, gflops);
+	tuning_db_store(device_name, kernel_name, dims, best_params, gflops);
+	// only the winner goes to the kernel cache, which also saves its binary for later runs
+	char defines[MAX_DEFINES_SIZE];
+	get_tuning_defines(defines, best_params);
+	kernel_cache_get(context, device_id, kernel_file, kernel_name, defines);
+	return best_params;
+}
 
-	err = clReleaseKernel(kernel);
-	if (err != CL_SUCCESS)
+void openclBenchTiling(int mult_type, MatMultDims dims, int count, const TileParams *tile_params, double *gflops)
+{
+	char *kernel_file;
+	char *kernel_name = get_tiled_kernel_name(mult_type, &kernel_file);
+	if (kernel_name == NULL)
 	{
-		printf("Could not release mult kernel, code: %d\n", err);
+		printf("mult type has no tiling: %d\n", mult_type);
 		exit(1);
 	}
+	// the operands and the reference result are shared by all the tilings
+	TuneOperands ops;
+	create_tune_operands(dims, &ops);
+	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n * (long long)(2 * dims.k - 1);
+	for (int i = 0; i < count; i++)
+	{
+		double time_passed = time_tiling_params(kernel_file, kernel_name, mult_type, tile_params[i], dims, &ops);
+		gflops[i] = time_passed < 0 ? -1 : FLOPs * 1e-9 / time_passed;
+	}
+	release_tune_operands(&ops);
+}
+
+static const char *mult_type_names[MatMultPlanTypes] = {"simple", "tiling", "tiling col major", "tiling col major padded", "host blocked"};
+
+// work per sec of the runs (count >= 2) by a least squares fit of secs = fixed + work / rate
+static double fit_rate(const double *work, const double *secs, int count, double *fixed_secs)
+{
+	double mean_work = 0, mean_secs = 0;
+	for (int i = 0; i < count; i++)
+	{
+		mean_work += work[i] / count;
+		mean_secs += secs[i] / count;
+	}
+	double cov = 0, var = 0;
+	for (int i = 0; i < count; i++)
+	{
+		cov += (work[i] - mean_work) * (secs[i] - mean_secs);
+		var += (work[i] - mean_work) * (work[i] - mean_work);
+	}
+	// timer noise on tiny runs, all of the time goes to the rate
+	if (cov <= 0 || var <= 0 || mean_secs - cov / var * mean_work < 0)
+	{
+		if (fixed_secs)
+			*fixed_secs = 0;
+		return work[count - 1] / fmax(secs[count - 1], 1e-9);
+	}
+	if (fixed_secs)
+		*fixed_secs = mean_secs - cov / var * mean_work;
+	return var / cov;
+}
+
+// times the transfer, the transpose and the kernel of each mult type on size * size * size
+static void calibrate_size(int size, double *transfer_secs, double *copy_secs, double *kernel_secs)
+{
+	MatMultDims dims = {size, size, size};
+	printf("calibrating the auto mult with %d, %d, %d\n", size, size, size);
+
+	float *a = create(size, size, 0);
+	float *b = create(size, size, 0);
+	float *c = create(size, size, 0);
+	for (long i = 0; i < (long)size * size; i++)
+	{
+		a[i] = (float)(i % 7 - 3);
+		b[i] = (float)(i % 5 - 2);
+	}
 
-	err = clReleaseProgram(program);
+	// host to device transfers
+	size_t size_bytes = (size_t)size * size * sizeof(float);
+	cl_mem buffer = buffer_pool_acquire(context, size_bytes);
+	cl_event event;
+	cl_int err = clEnqueueWriteBuffer(queue, buffer, CL_TRUE, 0, size_bytes, a, 0, NULL, &event);
+	cl_ulong time_start = 0;
+	cl_ulong time_end = 0;
+	err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(event);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not release mult program, code: %d\n", err);
+		printf("Could not measure the transfer rate, code: %d\n", err);
 		exit(1);
 	}
+	*transfer_secs = (time_end - time_start) / (double)1e9;
+
+	// device memory moves (transpose and padding copies)
+	MatHandle *ha = matHandleUpload(size, size, a);
+	MatHandle *hb = matHandleUpload(size, size, b);
+	MatTransposeDims transpose_dims = {size, size, size, size};
+	*copy_secs = enqueue_transpose("kernel_transpose.cl", "transpose", transpose_dims, ha->data, buffer, MatFloat32);
+	buffer_pool_release(buffer);
+
+	// kernels on the operands they read, padding is not needed for the calibration sizes
+	cl_mem d_c = buffer_pool_acquire(context, size_bytes);
+	for (int mult_type = MatMultSimple; mult_type <= MatMultTilingColMajPadded; mult_type++)
+	{
+		char *kernel_file = "kernel_matmult.cl";
+		char *kernel_name = "matmult_simple";
+		TileParams tile_params;
+		MatMultDims kernel_dims = dims;
+		cl_mem d_a = ha->data;
+		cl_mem d_b = hb->data;
+		if (mult_type != MatMultSimple)
+		{
+			kernel_name = get_tiled_kernel_name(mult_type, &kernel_file);
+			set_tiling_params(kernel_name, dims, &tile_params);
+		}
+		if (mult_type == MatMultTilingColMaj)
+		{
+			d_a = get_mat_handle_form(ha, true, size, size);
+		}
+		else if (mult_type == MatMultTilingColMajPadded)
+		{
+			MatMultDims padded_dims = get_padded_dims(dims, &tile_params);
+			d_a = get_mat_handle_form(ha, true, padded_dims.k, padded_dims.m);
+			d_b = get_mat_handle_form(hb, false, padded_dims.k, padded_dims.n);
+			if (padded_dims.m != size || padded_dims.n != size)
+			{
+				buffer_pool_release(d_c);
+				d_c = buffer_pool_acquire(context, (size_t)padded_dims.m * padded_dims.n * sizeof(float));
+			}
+			kernel_dims = padded_dims;
+		}
+		kernel_secs[mult_type] = enqueue_mult(kernel_file, kernel_name, kernel_dims, d_a, d_b, d_c,
+											  mult_type != MatMultSimple, &tile_params, MatFloat32);
+	}
+	buffer_pool_release(d_c);
+	matHandleRelease(hb);
+	matHandleRelease(ha);
+
+	time_t start = gettime();
+	memset(c, 0, size_bytes);
+	multBlocked(size, size, size, a, b, c);
+	kernel_secs[MatMultHostBlocked] = difftime(gettime(), start) / 1e9;
+
+	free(a);
+	free(b);
+	free(c);
+}
+
+void openclMatMultCalibrate()
+{
+	// fixed cost of a call, the second call so the kernel build is not counted
+	MatMultDims tiny_dims = {default_local_size, default_local_size, default_local_size};
+	float *tiny_a = create(default_local_size, default_local_size, 0);
+	float *tiny_b = create(default_local_size, default_local_size, 0);
+	float *tiny_c = create(default_local_size, default_local_size, 0);
+	for (int i = 0; i < 2; i++)
+	{
+		time_t start = gettime();
+		openclMatMultSimple(tiny_dims, tiny_a, tiny_b, tiny_c);
+		auto_launch_secs = difftime(gettime(), start) / 1e9;
+	}
+	free(tiny_a);
+	free(tiny_b);
+	free(tiny_c);
+
+	double bytes[AUTO_CALIBRATION_SIZES], elements[AUTO_CALIBRATION_SIZES], flops[AUTO_CALIBRATION_SIZES];
+	double transfer_secs[AUTO_CALIBRATION_SIZES], copy_secs[AUTO_CALIBRATION_SIZES];
+	double kernel_secs[MatMultPlanTypes][AUTO_CALIBRATION_SIZES];
+	for (int i = 0; i < AUTO_CALIBRATION_SIZES; i++)
+	{
+		double size = auto_calibration_sizes[i];
+		double size_kernel_secs[MatMultPlanTypes];
+		calibrate_size(auto_calibration_sizes[i], &transfer_secs[i], &copy_secs[i], size_kernel_secs);
+		for (int mult_type = 0; mult_type < MatMultPlanTypes; mult_type++)
+			kernel_secs[mult_type][i] = size_kernel_secs[mult_type];
+		bytes[i] = size * size * sizeof(float);
+		elements[i] = size * size;
+		flops[i] = size * size * (2 * size - 1);
+	}
 
-	free(source_str);
-	fflush(stdout);
-	return 0;
+	// the fixed costs of the transfers and copies are part of the call overhead
+	auto_transfer_rate = fit_rate(bytes, transfer_secs, AUTO_CALIBRATION_SIZES, NULL);
+	auto_copy_rate = fit_rate(elements, copy_secs, AUTO_CALIBRATION_SIZES, NULL);
+	for (int mult_type = 0; mult_type < MatMultPlanTypes; mult_type++)
+		auto_kernel_gflops[mult_type] = fit_rate(flops, kernel_secs[mult_type], AUTO_CALIBRATION_SIZES,
+												 &auto_kernel_secs[mult_type]) * 1e-9;
+
+	auto_calibrated = true;
+	printf("calibrated call overhead (secs): %.6lf, transfer rate (GB/s): %.2lf, device copy rate (Gelements/s): %.2lf\n",
+		   auto_launch_secs, auto_transfer_rate * 1e-9, auto_copy_rate * 1e-9);
+	for (int i = 0; i < MatMultPlanTypes; i++)
+		printf("calibrated %s GFLOPS: %.2lf, fixed secs: %.6lf\n", mult_type_names[i], auto_kernel_gflops[i],
+			   auto_kernel_secs[i]);
 }
 
-int cl_transpose(char *kernel_file, char *kernel_name,
-				 MatTransposeDims dims,
-				 float *a, cl_mem d_at)
+// bytes written or read back for the operand, zero copy operands (see get_operand_mode) move nothing
+static double operand_transfer_bytes(const void *ptr, size_t size)
 {
+	return ptr == NULL || get_operand_mode(ptr, size) == OPERAND_COPY ? (double)size : 0;
+}
 
-	// Device input buffers
+int openclMatMultPlan(MatMultDims dims, const float *a, const float *b, const float *c, MatMultPlan *plan)
+{
+	if (!auto_calibrated)
+		openclMatMultCalibrate();
+
+	MatMultPlan local_plan;
+	if (plan == NULL)
+		plan = &local_plan;
+	double m = dims.m, k = dims.k, n = dims.n;
+	double flops = m * n * (2 * k - 1);
+	size_t size_a = (size_t)dims.m * dims.k * sizeof(float);
+	size_t size_b = (size_t)dims.k * dims.n * sizeof(float);
+	size_t size_c = (size_t)dims.m * dims.n * sizeof(float);
+	// the simple and tiling mults use the operands as they are, the col major mults always write a
+	// and the padded mult copies b and c too when they need padding
+	double bytes_b = operand_transfer_bytes(b, size_b);
+	double bytes_c = operand_transfer_bytes(c, size_c);
+	plan->transfer_secs = auto_launch_secs + (operand_transfer_bytes(a, size_a) + bytes_b + bytes_c) / auto_transfer_rate;
+
+	plan->costs[MatMultSimple] = plan->transfer_secs + auto_kernel_secs[MatMultSimple] +
+								 flops * 1e-9 / auto_kernel_gflops[MatMultSimple];
+	for (int mult_type = MatMultTiling; mult_type <= MatMultTilingColMajPadded; mult_type++)
+	{
+		// the blocks at the edges cost as much as full blocks
+		TileParams tile_params;
+		set_tiling_params(get_tiled_kernel_name(mult_type, NULL), dims, &tile_params);
+		MatMultDims padded_dims = get_padded_dims(dims, &tile_params);
+		double pm = padded_dims.m, pk = padded_dims.k, pn = padded_dims.n;
+		bool padded = pm != m || pk != k || pn != n;
+		double transfer_secs = plan->transfer_secs;
+		if (mult_type == MatMultTilingColMaj || mult_type == MatMultTilingColMajPadded)
+			transfer_secs = auto_launch_secs + (size_a + bytes_b + bytes_c) / auto_transfer_rate;
+		if (mult_type == MatMultTilingColMajPadded && padded)
+			transfer_secs = auto_launch_secs + (size_a + size_b + size_c) / auto_transfer_rate;
+		double cost = transfer_secs + auto_kernel_secs[mult_type] + pm * pn * (2 * pk - 1) * 1e-9 / auto_kernel_gflops[mult_type];
+		if (mult_type == MatMultTilingColMaj)
+			cost += m * k / auto_copy_rate;
+		else if (mult_type == MatMultTilingColMajPadded)
+			cost += (pk * pm + pk * pn + pm * pn) / auto_copy_rate;
+		plan->costs[mult_type] = cost;
+	}
+	plan->costs[MatMultHostBlocked] = auto_kernel_secs[MatMultHostBlocked] + flops * 1e-9 / auto_kernel_gflops[MatMultHostBlocked];
+
+	plan->mult_type = MatMultSimple;
+	for (int i = 0; i < MatMultPlanTypes; i++)
+	{
+		if (plan->costs[i] < plan->costs[plan->mult_type])
+			plan->mult_type = i;
+	}
+	return plan->mult_type;
+}
+
+void openclMatMultAuto(MatMultDims dims, float *a, float *b, float *c)
+{
+	MatMultPlan plan;
+	openclMatMultPlan(dims, a, b, c, &plan);
+	printf("auto plan for %d, %d, %d (estimated secs):", dims.m, dims.k, dims.n);
+	for (int i = 0; i < MatMultPlanTypes; i++)
+		printf(" %s: %.6lf,", mult_type_names[i], plan.costs[i]);
+	printf(" using %s\n", mult_type_names[plan.mult_type]);
+	openclMatMult(dims, a, b, c, plan.mult_type);
+}
+
+// kernel of the sgemm kernel file with the tiling and transpose defines
+static cl_kernel get_sgemm_kernel(char *kernel_file, char *kernel_name,
+								  MatTranspose transA, MatTranspose transB,
+								  TileParams *tile_params)
+{
+	return get_device_sgemm_kernel(device_id, kernel_file, kernel_name, transA, transB, tile_params);
+}
+
+static cl_kernel get_device_sgemm_kernel(cl_device_id device, char *kernel_file, char *kernel_name,
+										 MatTranspose transA, MatTranspose transB,
+										 TileParams *tile_params)
+{
+	char defines[MAX_DEFINES_SIZE] = "";
+	if (transA == MatTrans)
+		strcat(defines, "#define TRANSA\r\n");
+	if (transB == MatTrans)
+		strcat(defines, "#define TRANSB\r\n");
+	get_kernel_defines(defines + strlen(defines), *tile_params);
+
+	if (validate_params)
+	{
+		validate_tiling(*tile_params, default_local_size);
+	}
+	return kernel_cache_get(context, device, kernel_file, kernel_name, defines);
+}
+
+// the operands are uploaded as they are, the kernel reads them through the leading dimensions
+// c is only uploaded if beta is not zero and is read back row by row so the gaps are not overwritten
+int cl_sgemm(char *kernel_file, char *kernel_name,
+			 MatTranspose transA, MatTranspose transB, int M, int N, int K,
+			 float alpha, const float *a, int lda, long long strideA, const float *b, int ldb, long long strideB,
+			 float beta, float *c, int ldc, long long strideC, int batch,
+			 TileParams *tile_params)
+{
 	cl_mem d_a;
+	cl_mem d_b;
+	cl_mem d_c;
+
+	cl_kernel kernel;
 
-	cl_program program; // program
-	cl_kernel kernel;	// kernel
 	cl_int err;
+	size_t local[3], global[3];
+
+	kernel = get_sgemm_kernel(kernel_file, kernel_name, transA, transB, tile_params);
+
+	local[0] = tile_params->BM / tile_params->WIM;
+	local[1] = tile_params->BN / tile_params->WIN;
+	global[0] = (size_t)(ceil(M / (float)tile_params->BM) * tile_params->BM / tile_params->WIM);
+	global[1] = (size_t)(ceil(N / (float)tile_params->BN) * tile_params->BN / tile_params->WIN);
+	// one batch per work group in dim 2
+	local[2] = 1;
+	global[2] = batch;
+
+	// only the spans that are addressed through the leading dimensions and batch strides
+	size_t a_size = ((size_t)(batch - 1) * strideA + (size_t)((transA == MatTrans ? K : M) - 1) * lda + (transA == MatTrans ? M : K)) * sizeof(*a);
+	size_t b_size = ((size_t)(batch - 1) * strideB + (size_t)((transB == MatTrans ? N : K) - 1) * ldb + (transB == MatTrans ? K : N)) * sizeof(*b);
+	size_t c_size = ((size_t)(batch - 1) * strideC + (size_t)(M - 1) * ldc + N) * sizeof(*c);
+	// batches of c can be read back with a single rect read if they are whole rows apart,
+	// otherwise c is uploaded and read back as a whole so the gaps are preserved
+	bool read_rect = strideC % ldc == 0;
+	bool write_c = beta != 0.0f || !read_rect;
 
-	FILE *cl_code = fopen(kernel_file, "rb");
-	if (cl_code == NULL)
+	printf("creating buffers\n");
+	d_a = buffer_pool_acquire(context, a_size);
+	d_b = buffer_pool_acquire(context, b_size);
+	d_c = buffer_pool_acquire(context, c_size);
+
+	printf("writing buffers\n");
+	cl_event wevent, kevent, revent;
+	cl_ulong time_start = 0;
+	cl_ulong time_end = 0;
+	double time_passed_write;
+	err = clEnqueueWriteBuffer(queue, d_a, CL_TRUE, 0, a_size, a, 0, NULL, NULL);
+	if (write_c)
+		err |= clEnqueueWriteBuffer(queue, d_c, CL_TRUE, 0, c_size, c, 0, NULL, NULL);
+	err |= clEnqueueWriteBuffer(queue, d_b, CL_TRUE, 0, b_size, b, 0, NULL, &wevent);
+	if (err != CL_SUCCESS)
 	{
-		printf("Could not open transpose kernel file: %s\n", kernel_file);
+		printf("Could not enqueue sgemm buffers, code: %d\n", err);
 		exit(1);
 	}
+	clWaitForEvents(1, &wevent);
+	err = clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(wevent);
+	time_passed_write = (time_end - time_start) / (double)1e9;
+	printf("sgemm write time (sec): %f\n", time_passed_write);
 
-	char *source_str = (char *)malloc(MAX_SOURCE_SIZE + 1);
-	memset(source_str, 0, MAX_SOURCE_SIZE + 1);
-	int res = fread(source_str, 1, MAX_SOURCE_SIZE, cl_code);
-	fclose(cl_code);
-
-	// printf("transpose kernel\r\n%s:", source_str);
-
-	// Create the compute program from the source buffer
-	program = clCreateProgramWithSource(context, 1, (const char **)&source_str, NULL, &err);
+	printf("setting kernel args\n");
+	int param = 0;
+	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&M);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&N);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&K);
+	err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&alpha);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	cl_long cl_strideA = strideA, cl_strideB = strideB, cl_strideC = strideC;
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&lda);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&cl_strideA);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&ldb);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&cl_strideB);
+	err |= clSetKernelArg(kernel, param++, sizeof(float), (void *)&beta);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
+	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&ldc);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_long), (void *)&cl_strideC);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not create transpose program, code: %d\n", err);
+		printf("Could not set sgemm kernel args, code: %d\n", err);
 		exit(1);
 	}
+	printf("sgemm transA: %d, transB: %d, lda: %d, ldb: %d, ldc: %d, batch: %d\n",
+		   transA == MatTrans, transB == MatTrans, lda, ldb, ldc, batch);
+	printf("local_size: %lld:%lld:%lld, global_size: %lld:%lld:%lld\r\n", local[0], local[1], local[2], global[0], global[1], global[2]);
 
-	// Build the program executable
-	err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+	printf("exec kernel\n");
+	fflush(stdout);
+	double time_passed_kernel;
+	err = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global, local, 0, NULL, &kevent);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not build transpose program, code: %d\n", err);
-		if (err == CL_BUILD_PROGRAM_FAILURE)
-		{
-			printBuildError(device_id, program);
-		}
+		printf("Could not exec sgemm kernel, code: %d\n", err);
+		exit(1);
+	}
+	clWaitForEvents(1, &kevent);
+	err = clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(kevent);
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not get profiling sgemm kernel, code: %d\n", err);
 		exit(1);
 	}
+	unsigned long long FLOPs = (long long)batch * (long long)M * (long long)N * (long long)(2 * K - 1);
+	printf("sgemm estimated FLOPs: %llu\n", FLOPs);
+	time_passed_kernel = (time_end - time_start) / (double)1e9;
+	printf("sgemm kernel time (sec): %f\n", time_passed_kernel);
+	printf("sgemm GFLOPS: %lf\n", FLOPs * 1e-9 / time_passed_kernel);
 
-	// Create the compute kernel in the program we wish to run
-	kernel = clCreateKernel(program, kernel_name, &err);
+	// read back only the M*N windows, the host gaps between rows of c are left untouched
+	double time_passed_read;
+	if (read_rect)
+	{
+		size_t origin[3] = {0, 0, 0};
+		size_t region[3] = {N * sizeof(*c), M, batch};
+		size_t slice_pitch = batch > 1 ? strideC * sizeof(*c) : 0;
+		err = clEnqueueReadBufferRect(queue, d_c, CL_TRUE, origin, origin, region,
+									  ldc * sizeof(*c), slice_pitch, ldc * sizeof(*c), slice_pitch,
+									  c, 0, NULL, &revent);
+	}
+	else
+	{
+		err = clEnqueueReadBuffer(queue, d_c, CL_TRUE, 0, c_size, c, 0, NULL, &revent);
+	}
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not create transpose kernel, code: %d\n", err);
+		printf("Could not read sgemm result, code: %d\n", err);
 		exit(1);
 	}
+	clWaitForEvents(1, &revent);
+	err = clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(revent);
+	time_passed_read = (time_end - time_start) / (double)1e9;
+	printf("sgemm read time (sec): %f\n", time_passed_read);
 
-	int max_local_size = getMaxLocalSize(kernel, device_id, 2);
-	printf("transpose max_local_size: %d\n", max_local_size);
-	size_t t_local[2] = {max_local_size, max_local_size};
-	size_t t_global[2] = {
-		(size_t)(int)(ceil(dims.m / (float)t_local[0]) * t_local[0]),
-		(size_t)(int)(ceil(dims.n / (float)t_local[1]) * t_local[1])};
+	buffer_pool_release(d_a);
+	buffer_pool_release(d_b);
+	buffer_pool_release(d_c);
 
-	d_a = clCreateBuffer(context, CL_MEM_READ_ONLY, dims.m * dims.n * sizeof(*a), NULL, NULL);
+	return 0;
+}
 
-	// Write our data set into the input array in device memory
-	err = clEnqueueWriteBuffer(queue, d_a, CL_FALSE, 0, dims.m * dims.n * sizeof(*a), a, 0, NULL, NULL);
+// the operands of all problems are written next to each other into one device buffer each,
+// each problem gets a row in the descriptor table with its dims, packed offsets and its first tile
+// returns the device memory used for the packed operands
+size_t cl_sgemm_grouped(char *kernel_file, char *kernel_name,
+					 int count, MatMultDims *dims,
+					 float *a, size_t *offsetsA, float *b, size_t *offsetsB, float *c, size_t *offsetsC,
+					 TileParams *tile_params)
+{
+	cl_mem d_desc;
+	cl_mem d_a;
+	cl_mem d_b;
+	cl_mem d_c;
 
-	// Set the arguments to our compute kernel
-	int param = 0;
-	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.m);
-	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.n);
-	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.tm);
-	err |= clSetKernelArg(kernel, param++, sizeof(int), (void *)&dims.tn);
-	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
-	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_at);
-	if (err != CL_SUCCESS)
+	cl_kernel kernel;
+
+	cl_int err;
+	size_t local[2], global[2];
+
+	// problems without any output have no tiles and are left out of the table
+	int *desc = (int *)malloc(sizeof(int) * GROUP_DESC_SIZE * (count > 0 ? count : 1));
+	int *problem_index = (int *)malloc(sizeof(int) * (count > 0 ? count : 1));
+	size_t size_a = 0, size_b = 0, size_c = 0;
+	long long tiles = 0;
+	int problems = 0;
+	for (int i = 0; i < count; i++)
 	{
-		printf("Could not set kernel args, code: %d\n", err);
+		int tiles_m = (dims[i].m + tile_params->BM - 1) / tile_params->BM;
+		int tiles_n = (dims[i].n + tile_params->BN - 1) / tile_params->BN;
+		if (tiles_m == 0 || tiles_n == 0)
+			continue;
+		int *problem = desc + problems * GROUP_DESC_SIZE;
+		problem[0] = dims[i].m;
+		problem[1] = dims[i].n;
+		problem[2] = dims[i].k;
+		problem[3] = (int)size_a;
+		problem[4] = (int)size_b;
+		problem[5] = (int)size_c;
+		problem[6] = (int)tiles;
+		problem[7] = tiles_n;
+		problem_index[problems] = i;
+		size_a += (size_t)dims[i].m * dims[i].k;
+		size_b += (size_t)dims[i].k * dims[i].n;
+		size_c += (size_t)dims[i].m * dims[i].n;
+		tiles += (long long)tiles_m * tiles_n;
+		problems++;
+	}
+	if (problems == 0)
+	{
+		free(desc);
+		free(problem_index);
+		return 0;
+	}
+	// the kernel uses int offsets
+	if (size_a > INT_MAX || size_b > INT_MAX || size_c > INT_MAX || tiles > INT_MAX)
+	{
+		printf("grouped mult problems too large: %zu, %zu, %zu, tiles: %lld\n", size_a, size_b, size_c, tiles);
 		exit(1);
 	}
 
-	// printf("t_local_size: %ld:%ld, t_global_size: %ld:%ld\r\n", t_local[0], t_local[1], t_global[0], t_global[1]);
+	// a and b are empty if all problems have K == 0, but still need valid buffers
+	size_t buffer_size_a = (size_a > 0 ? size_a : 1) * sizeof(float);
+	size_t buffer_size_b = (size_b > 0 ? size_b : 1) * sizeof(float);
+	kernel = get_sgemm_kernel(kernel_file, kernel_name, MatNoTrans, MatNoTrans, tile_params);
 
-	cl_event event;
+	local[0] = tile_params->BM / tile_params->WIM;
+	local[1] = tile_params->BN / tile_params->WIN;
+	global[0] = (size_t)tiles * local[0];
+	global[1] = local[1];
+
+	printf("creating buffers\n");
+	d_desc = buffer_pool_acquire(context, problems * GROUP_DESC_SIZE * sizeof(int));
+	d_a = buffer_pool_acquire(context, buffer_size_a);
+	d_b = buffer_pool_acquire(context, buffer_size_b);
+	d_c = buffer_pool_acquire(context, size_c * sizeof(float));
+
+	printf("writing buffers\n");
+	cl_event wevent_first, wevent, kevent, revent;
 	cl_ulong time_start = 0;
 	cl_ulong time_end = 0;
-	double time_passed_kernel;
-
-	// printf("exec kernel: %s\r\n", kernel_name);
-	fflush(stdout);
-	// Execute the kernel over the entire range of the data set
-	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, t_global, t_local, 0, NULL, &event);
-	if (err != CL_SUCCESS)
+	double time_passed_write;
+	err = clEnqueueWriteBuffer(queue, d_desc, CL_FALSE, 0, problems * GROUP_DESC_SIZE * sizeof(int), desc, 0, NULL, &wevent_first);
+	// each operand is written straight from the caller memory at its packed offset
+	for (int p = 0; p < problems; p++)
 	{
-		printf("Could not exec transpose kernel, code: %d\n", err);
-		exit(1);
+		int *problem = desc + p * GROUP_DESC_SIZE;
+		int i = problem_index[p];
+		size_t problem_size_a = (size_t)dims[i].m * dims[i].k * sizeof(float);
+		size_t problem_size_b = (size_t)dims[i].k * dims[i].n * sizeof(float);
+		if (problem_size_a > 0)
+			err |= clEnqueueWriteBuffer(queue, d_a, CL_FALSE, problem[3] * sizeof(float), problem_size_a,
+										a + offsetsA[i], 0, NULL, NULL);
+		if (problem_size_b > 0)
+			err |= clEnqueueWriteBuffer(queue, d_b, CL_FALSE, problem[4] * sizeof(float), problem_size_b,
+										b + offsetsB[i], 0, NULL, NULL);
 	}
-
-	clWaitForEvents(1, &event);
-	clFinish(queue);
-	err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-	err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clEnqueueMarkerWithWaitList(queue, 0, NULL, &wevent);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not get profiling transpose kernel, code: %d\n", err);
+		printf("Could not enqueue grouped mult buffers, code: %d\n", err);
 		exit(1);
 	}
-	// transpose kernel FLOPs estimated:
-	unsigned long long FLOPs = (long long)dims.m * (long long)dims.n;
-	printf("transpose estimated FLOPs: %llu\n", FLOPs);
-	time_passed_kernel = (time_end - time_start) / (double)1e9;
-	// printf("transpose kernel time (sec): %f\n", time_passed_kernel);
-	printf("transpose GFLOPS: %lf\n", FLOPs * 1e-9 / time_passed_kernel);
+	clWaitForEvents(1, &wevent);
+	err = clGetEventProfilingInfo(wevent_first, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(wevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(wevent_first);
+	err |= clReleaseEvent(wevent);
+	time_passed_write = (time_end - time_start) / (double)1e9;
+	printf("grouped mult write time (sec): %f\n", time_passed_write);
 
-	err = clReleaseEvent(event);
+	printf("setting kernel args\n");
+	int param = 0;
+	err = clSetKernelArg(kernel, param++, sizeof(int), (void *)&problems);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_desc);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_a);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_b);
+	err |= clSetKernelArg(kernel, param++, sizeof(cl_mem), (void *)&d_c);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not release transpose event, code: %d\n", err);
+		printf("Could not set grouped mult kernel args, code: %d\n", err);
 		exit(1);
 	}
+	printf("grouped mult problems: %d, tiles: %lld\n", problems, tiles);
+	printf("local_size: %lld:%lld, global_size: %lld:%lld\r\n", local[0], local[1], global[0], global[1]);
 
-	err = clReleaseMemObject(d_a);
-	// TODO: releasing the output buffer causes problems when it is read again by another kernel
-	// err |= clReleaseMemObject(d_c);
+	printf("exec kernel\n");
+	fflush(stdout);
+	double time_passed_kernel;
+	err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &kevent);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not release transpose memory, code: %d\n", err);
+		printf("Could not exec grouped mult kernel, code: %d\n", err);
 		exit(1);
 	}
-
-	err = clReleaseKernel(kernel);
+	clWaitForEvents(1, &kevent);
+	err = clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(kevent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(kevent);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not release transpose kernel, code: %d\n", err);
+		printf("Could not get profiling grouped mult kernel, code: %d\n", err);
 		exit(1);
 	}
+	time_passed_kernel = (time_end - time_start) / (double)1e9;
+	printf("grouped mult kernel time (sec): %f\n", time_passed_kernel);
 
-	err = clReleaseProgram(program);
+	// each c is read back from its packed offset to the c of its problem
+	double time_passed_read;
+	cl_event revent_first = NULL;
+	err = CL_SUCCESS;
+	for (int p = 0; p < problems; p++)
+	{
+		int *problem = desc + p * GROUP_DESC_SIZE;
+		int i = problem_index[p];
+		err |= clEnqueueReadBuffer(queue, d_c, CL_FALSE, problem[5] * sizeof(float),
+								   (size_t)dims[i].m * dims[i].n * sizeof(float), c + offsetsC[i],
+								   0, NULL, p == 0 ? &revent_first : NULL);
+	}
+	err |= clEnqueueMarkerWithWaitList(queue, 0, NULL, &revent);
 	if (err != CL_SUCCESS)
 	{
-		printf("Could not release transpose program, code: %d\n", err);
+		printf("Could not read grouped mult result, code: %d\n", err);
 		exit(1);
 	}
+	clWaitForEvents(1, &revent);
+	err = clGetEventProfilingInfo(revent_first, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	err |= clGetEventProfilingInfo(revent, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+	err |= clReleaseEvent(revent_first);
+	err |= clReleaseEvent(revent);
+	time_passed_read = (time_end - time_start) / (double)1e9;
+	printf("grouped mult read time (sec): %f\n", time_passed_read);
 
-	free(source_str);
-	fflush(stdout);
-	return 0;
+	buffer_pool_release(d_desc);
+	buffer_pool_release(d_a);
+	buffer_pool_release(d_b);
+	buffer_pool_release(d_c);
+
+	free(desc);
+	free(problem_index);
+	return (size_a + size_b + size_c) * sizeof(float);
 }
 
 void printBuildError(cl_device_id device_id, cl_program program)
@@ -709,6 +3124,69 @@ void printBuildError(cl_device_id device_id, cl_program program)
 	free(log);
 }
 
+// the kernels with the default tiling params, as used by openclMatMult and sgemm
+static void warmup_kernels()
+{
+	TileParams tile_params;
+	char tiling_defines[MAX_DEFINES_SIZE], mult_defines[MAX_DEFINES_SIZE];
+	set_default_tiling_params(&tile_params);
+	get_kernel_defines(tiling_defines, tile_params);
+	strcpy(mult_defines, tiling_defines);
+	get_dtype_defines(mult_defines + strlen(mult_defines), MatFloat32);
+
+	const char *kernel_files[] = {
+		"kernel_matmult_tiling.cl",
+		"kernel_matmult_tiling_colmajor.cl",
+		"kernel_matmult_tiling_colmajor_padded.cl",
+		"kernel_transpose.cl",
+		"kernel_sgemm.cl"};
+	const char *kernel_names[] = {
+		"matmult_block",
+		"matmult_block_colmajor",
+		"matmult_block_colmajor_padded",
+		"transpose",
+		"sgemm_block"};
+	const char *defines[] = {mult_defines, mult_defines, mult_defines, NULL, tiling_defines};
+	kernel_cache_warmup(context, device_id, sizeof(kernel_names) / sizeof(kernel_names[0]),
+						kernel_files, kernel_names, defines);
+}
+
+// partitions the device by numa node, by the next partitionable affinity domain or in halves
+// returns the number of sub devices, 0 if the device can not be partitioned
+static int create_sub_devices(cl_device_id device, cl_device_id *sub_devices)
+{
+	cl_uint count = 0;
+	cl_int err;
+	cl_device_partition_property numa[] = {
+		CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+	cl_device_partition_property next[] = {
+		CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE, 0};
+	err = clCreateSubDevices(device, numa, MAX_DEVICES, sub_devices, &count);
+	if (err != CL_SUCCESS || count < 2)
+	{
+		if (err == CL_SUCCESS)
+			clReleaseDevice(sub_devices[0]);
+		err = clCreateSubDevices(device, next, MAX_DEVICES, sub_devices, &count);
+	}
+	if (err != CL_SUCCESS || count < 2)
+	{
+		if (err == CL_SUCCESS)
+			clReleaseDevice(sub_devices[0]);
+		cl_uint compute_units = 0;
+		clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+		cl_device_partition_property equally[] = {CL_DEVICE_PARTITION_EQUALLY, compute_units / 2, 0};
+		err = compute_units >= 2 ? clCreateSubDevices(device, equally, MAX_DEVICES, sub_devices, &count)
+								 : CL_DEVICE_PARTITION_FAILED;
+	}
+	if (err != CL_SUCCESS)
+	{
+		printf("Could not create sub devices, code: %d\n", err);
+		return 0;
+	}
+	printf("sub devices: %d\n", count);
+	return (int)count;
+}
+
 void init_opencl()
 {
 	size_t strSize = (sizeof(char) * MAX_CHARS);
@@ -736,8 +3214,33 @@ void init_opencl()
 	}
 	printf("using device: %d:%s\n", currentDevice, device_name);
 
+	// the split devices share the context so the kernels and buffers are shared
+	cl_device_id context_devices[MAX_DEVICES + 1];
+	int num_context_devices = 0;
+	context_devices[num_context_devices++] = device_id;
+	if (use_sub_devices)
+	{
+		num_split_devices = create_sub_devices(device_id, split_devices);
+		split_sub_devices = num_split_devices > 0;
+		for (int i = 0; i < num_split_devices; i++)
+			context_devices[num_context_devices++] = split_devices[i];
+	}
+	else if (use_multi_device)
+	{
+		for (int i = 0; i < num_devices; i++)
+		{
+			split_devices[num_split_devices++] = device_ids[i];
+			if (device_ids[i] != device_id)
+				context_devices[num_context_devices++] = device_ids[i];
+		}
+	}
+	// without sub devices or other devices the mult runs on the device alone
+	if (num_split_devices == 0)
+		split_devices[num_split_devices++] = device_id;
+	printf("split devices: %d\n", num_split_devices);
+
 	// Create a context
-	context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+	context = clCreateContext(0, num_context_devices, context_devices, NULL, NULL, &err);
 	if (err != CL_SUCCESS)
 	{
 		printf("Could not create context, code: %d\n", err);
@@ -752,15 +3255,55 @@ void init_opencl()
 		exit(1);
 	}
 
+	for (int i = 0; i < num_split_devices; i++)
+	{
+		split_queues[i] = clCreateCommandQueue(context, split_devices[i], CL_QUEUE_PROFILING_ENABLE, &err);
+		if (err != CL_SUCCESS)
+		{
+			printf("Could not create split command queue, code: %d\n", err);
+			exit(1);
+		}
+		// equal shares until the throughput is measured
+		split_gflops[i] = 1.0;
+	}
+
 	max_shared_mem = getMaxSharedMemSize(device_id);
 	printf("max_shared_mem: %ld\n", max_shared_mem);
 
 	max_shared_mem_per_dim = (long)pow(max_shared_mem, 1.0f / 2);
 	printf("max_shared_mem per dim: %ld\n", max_shared_mem_per_dim);
+
+	host_unified_memory = getHostUnifiedMemory(device_id);
+	svm_capabilities = getSvmCapabilities(device_id);
+	mem_base_align = getMemBaseAddrAlign(device_id);
+	printf("host unified memory: %d, svm capabilities: %d, mem base align: %d\n",
+		   host_unified_memory, (int)svm_capabilities, mem_base_align);
+
+	if (use_kernel_warmup)
+	{
+		warmup_kernels();
+	}
 }
 
 void close_opencl()
 {
+	buffer_pool_close();
+	kernel_cache_close();
+	tuning_db_close();
+	if (io_queue)
+	{
+		clReleaseCommandQueue(io_queue);
+		io_queue = NULL;
+	}
+	for (int i = 0; i < num_split_devices; i++)
+	{
+		clReleaseCommandQueue(split_queues[i]);
+		if (split_sub_devices)
+			clReleaseDevice(split_devices[i]);
+	}
+	num_split_devices = 0;
+	split_sub_devices = false;
 	clReleaseCommandQueue(queue);
 	clReleaseContext(context);
+	device_id = NULL;
 }
\ No newline at end of file
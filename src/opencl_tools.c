@@ -31,6 +31,15 @@ SOFTWARE.
 #include <CL/opencl.h>
 #include "mat_tools.h"
 #include "opencl_tools.h"
+#include "kernel_cache.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define MKDIR(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MKDIR(path) mkdir(path, 0755)
+#endif
 
 int num_platforms;
 cl_platform_id platforms[MAX_PLATFORMS];
@@ -198,16 +207,73 @@ long getMaxSharedMemSize(cl_device_id device_id)
 	return (long)max_shared_mem;
 }
 
+size_t getGlobalMemSize(cl_device_id device_id)
+{
+	cl_int err;
+	cl_ulong global_mem = 0;
+
+	err = clGetDeviceInfo(device_id, CL_DEVICE_GLOBAL_MEM_SIZE,
+						  sizeof(global_mem), &global_mem, 0);
+	return (size_t)global_mem;
+}
+
+size_t getMaxMemAllocSize(cl_device_id device_id)
+{
+	cl_int err;
+	cl_ulong max_alloc = 0;
+
+	err = clGetDeviceInfo(device_id, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+						  sizeof(max_alloc), &max_alloc, 0);
+	return (size_t)max_alloc;
+}
+
+bool getHostUnifiedMemory(cl_device_id device_id)
+{
+	cl_int err;
+	cl_bool host_unified_memory = CL_FALSE;
+
+	// deprecated in opencl 2.0 but still reported by the runtimes
+	err = clGetDeviceInfo(device_id, CL_DEVICE_HOST_UNIFIED_MEMORY,
+						  sizeof(host_unified_memory), &host_unified_memory, 0);
+	return err == CL_SUCCESS && host_unified_memory;
+}
+
+cl_device_svm_capabilities getSvmCapabilities(cl_device_id device_id)
+{
+	cl_int err;
+	cl_device_svm_capabilities svm_caps = 0;
+
+	// fails for opencl 1.x devices
+	err = clGetDeviceInfo(device_id, CL_DEVICE_SVM_CAPABILITIES,
+						  sizeof(svm_caps), &svm_caps, 0);
+	return err == CL_SUCCESS ? svm_caps : 0;
+}
+
+int getMemBaseAddrAlign(cl_device_id device_id)
+{
+	cl_int err;
+	cl_uint align_bits = 0;
+
+	err = clGetDeviceInfo(device_id, CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+						  sizeof(align_bits), &align_bits, 0);
+	return err == CL_SUCCESS ? align_bits / 8 : 0;
+}
+
 int getMaxLocalSize(cl_kernel kernel, cl_device_id device_id, int dims)
 {
 	int maxWorkGroupSize = getWorkgroupSize(kernel, device_id);
 	return (int)pow(maxWorkGroupSize, 1.0f / dims);
 }
 
-void add_kernel_defines(char *source_str, TileParams tile_params)
+void add_kernel_source_defines(char *source_str, const char *defines)
 {
-	char *source_defines_str = (char *)malloc(4 * 1024 * sizeof(char));
+	size_t len = strlen(defines);
+	memmove(source_str + len, source_str, strlen(source_str) + 1);
+	memcpy(source_str, defines, len);
+}
 
+void get_kernel_defines(char *defines_str, TileParams tile_params)
+{
 	// size per work item for each submatrice: (size of submatrice tile) / (total size of a work group)
 	// total size of a work group: (size of output matrix) / (size of work item)
 	const int WIA_SIZE = tile_params.BK * tile_params.WIM * tile_params.WIN / tile_params.BN; // (BM * BK) / ((BM * BN) / (WIM * WIN));
@@ -216,7 +282,7 @@ void add_kernel_defines(char *source_str, TileParams tile_params)
 	// printf("BM: %d, BN: %d, BK: %d, WIM: %d, WIN: %d, WIA_SiZE: %d, WIB_SIZE: %d\n",
 	// BM, BN, BK, WIM, WIN, WIA_SIZE, WIB_SIZE);
 
-	sprintf(source_defines_str,
+	sprintf(defines_str,
 			"#define BM %d // block a height\r\n"
 			"#define BN %d // block b width\r\n"
 			"#define BK %d // block a width, b height\r\n"
@@ -224,73 +290,126 @@ void add_kernel_defines(char *source_str, TileParams tile_params)
 			"#define WIN %d // Work item width\r\n"
 			"#define WIA_SIZE %d // Work item a size\r\n"
 			"#define WIB_SIZE %d // Work item b size\r\n"
+			"#define VEC %d // Vector width of the loads and stores\r\n"
+			"#define DBUF %d // Double buffered local tiles\r\n"
+			"#define LPAD %d // Padding of the local tile rows\r\n"
 			"\r\n",
-			tile_params.BM, tile_params.BN, tile_params.BK, tile_params.WIM, tile_params.WIN, WIA_SIZE, WIB_SIZE);
-	size_t len = strlen(source_defines_str);
-	memmove(source_str + len, source_str, strlen(source_str) + 1);
-	memcpy(source_str, source_defines_str, len);
-	strcat(source_str, "\0");
-	free(source_defines_str);
+			tile_params.BM, tile_params.BN, tile_params.BK, tile_params.WIM, tile_params.WIN, WIA_SIZE, WIB_SIZE,
+			tile_params.VEC, tile_params.DBUF, tile_params.LPAD);
 }
 
-int get_kernel_max_local_size(cl_context context, char *source_str, char *kernel_name, cl_device_id device_id, TileParams tile_params)
+// storage type of the mult kernels, DTYPE_ID 0: float, 1: half, 2: bfloat16 stored as ushort
+// the loads (LOAD, LOADV of VEC elements) convert to the accumulator type ACCTYPE and the stores round from it
+// the vector forms use the CONCAT, vloadv and vstorev helpers of the vector kernels (VEC > 1)
+void get_dtype_defines(char *defines_str, int dtype)
 {
-	cl_program program;
-	cl_int err;
-	char *kernel_src = (char *)malloc(4 * 1024 * sizeof(char));
-
-	// printf("mult kernel\r\n%s:", source_str);
-
-	strcpy(kernel_src, source_str);
-	strcat(kernel_src, "\0");
-	add_kernel_defines(kernel_src, tile_params);
-
-	// printf("tuning mult kernel\r\n%s\r\n:", kernel_src);
-
-	// Create the compute program from the source buffer
-	program = clCreateProgramWithSource(context, 1, (const char **)&kernel_src, NULL, &err);
-	if (err != CL_SUCCESS)
+	const char *storage_defines;
+	switch (dtype)
 	{
-		printf("Could not create mult program, code: %d\n", err);
+	case MatFloat32:
+		storage_defines =
+			"#define DTYPE float\r\n"
+			"#define LOAD(i, p) ((p)[i])\r\n"
+			"#define STORE(v, i, p) ((p)[i] = (v))\r\n"
+			"#define LOADV(i, p) vloadv(i, p)\r\n"
+			"#define STOREV(v, i, p) vstorev(v, i, p)\r\n";
+		break;
+	case MatFloat16:
+		storage_defines =
+			"#define DTYPE half\r\n"
+			"#define LOAD(i, p) vload_half(i, p)\r\n"
+			"#define STORE(v, i, p) vstore_half(v, i, p)\r\n"
+			"#define LOADV(i, p) CONCAT(vload_half, VEC)(i, p)\r\n"
+			"#define STOREV(v, i, p) CONCAT(vstore_half, VEC)(v, i, p)\r\n";
+		break;
+	case MatBFloat16:
+		// round to nearest even like float_to_bf16, NaNs are kept quiet instead of rounding into infinity
+		storage_defines =
+			"#define DTYPE ushort\r\n"
+			"#define BF16_BITS(u) ((u & 0x7fffffff) > 0x7f800000 ? (u >> 16) | 0x40 : (u + 0x7fff + ((u >> 16) & 1)) >> 16)\r\n"
+			"#define LOAD(i, p) as_float((uint)(p)[i] << 16)\r\n"
+			"#define STORE(v, i, p) ((p)[i] = (ushort)BF16_BITS(as_uint(v)))\r\n"
+			"#define uintv CONCAT(uint, VEC)\r\n"
+			"#define BF16_BITSV(u) select((u + (uintv)(0x7fff) + ((u >> 16) & (uintv)(1))) >> 16, "
+			"(u >> 16) | (uintv)(0x40), (u & (uintv)(0x7fffffff)) > (uintv)(0x7f800000))\r\n"
+			"#define LOADV(i, p) CONCAT(as_float, VEC)(CONCAT(convert_uint, VEC)(vloadv(i, p)) << 16)\r\n"
+			"#define STOREV(v, i, p) vstorev(CONCAT(convert_ushort, VEC)(BF16_BITSV(CONCAT(as_uint, VEC)(v))), i, p)\r\n";
+		break;
+	default:
+		printf("Error: unknown dtype: %d\n", dtype);
 		exit(1);
 	}
+	sprintf(defines_str,
+			"#define DTYPE_ID %d // Storage type of the matrices\r\n"
+			"#define ACCTYPE float // Accumulator type\r\n"
+			"%s"
+			"\r\n",
+			dtype, storage_defines);
+}
 
-	// Build the program executable
-	err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-	if (err != CL_SUCCESS)
-	{
-		printf("Could not build mult program, code: %d\n", err);
-		if (err == CL_BUILD_PROGRAM_FAILURE)
-		{
-			printBuildError(device_id, program);
-		}
-		exit(1);
-	}
+void add_kernel_defines(char *source_str, TileParams tile_params)
+{
+	char *source_defines_str = (char *)malloc(MAX_DEFINES_SIZE * sizeof(char));
+	get_kernel_defines(source_defines_str, tile_params);
+	add_kernel_source_defines(source_str, source_defines_str);
+	free(source_defines_str);
+}
 
-	// Create the compute kernel in the program we wish to run
-	cl_kernel kernel = clCreateKernel(program, kernel_name, &err);
-	if (err != CL_SUCCESS)
-	{
-		printf("Could not create mult kernel: %s, code: %d\n", kernel_name, err);
-		exit(1);
-	}
+int get_kernel_max_local_size(cl_context context, char *kernel_file, char *kernel_name, cl_device_id device_id, TileParams tile_params)
+{
+	char defines[MAX_DEFINES_SIZE];
+	get_kernel_defines(defines, tile_params);
+	// the limits of the float build, the storage type only changes the loads and stores
+	get_dtype_defines(defines + strlen(defines), MatFloat32);
+	// the program is cached so a later build with the same params is free
+	cl_kernel kernel = kernel_cache_get(context, device_id, kernel_file, kernel_name, defines);
 
 	int max_local_size = getMaxLocalSize(kernel, device_id, 2);
 	printf("max_local_size: %d\n", max_local_size);
+	return max_local_size;
+}
 
-	err = clReleaseKernel(kernel);
-	if (err != CL_SUCCESS)
+char *copy_str(const char *str)
+{
+	char *copy = (char *)malloc(strlen(str) + 1);
+	strcpy(copy, str);
+	return copy;
+}
+
+char *get_cache_path(const char *env_name, const char *name)
+{
+	const char *path = getenv(env_name);
+	if (path != NULL)
 	{
-		printf("Could not release mult kernel, code: %d\n", err);
-		exit(1);
+		// empty disables the cache
+		return path[0] != '\0' ? copy_str(path) : NULL;
 	}
+#ifdef _WIN32
+	const char *home = getenv("LOCALAPPDATA");
+	const char *sub_dir = "/matmul/";
+#else
+	const char *home = getenv("HOME");
+	const char *sub_dir = "/.cache/matmul/";
+#endif
+	if (home == NULL)
+		return NULL;
+	char *cache_path = (char *)malloc(strlen(home) + strlen(sub_dir) + strlen(name) + 1);
+	sprintf(cache_path, "%s%s%s", home, sub_dir, name);
+	return cache_path;
+}
 
-	err = clReleaseProgram(program);
-	if (err != CL_SUCCESS)
+void make_dirs(const char *file_path)
+{
+	char *path = copy_str(file_path);
+	for (char *p = path + 1; *p; p++)
 	{
-		printf("Could not release mult program, code: %d\n", err);
-		exit(1);
+		if (*p == '/' || *p == '\\')
+		{
+			char sep = *p;
+			*p = '\0';
+			MKDIR(path);
+			*p = sep;
+		}
 	}
-	free(kernel_src);
-	return max_local_size;
-}
\ No newline at end of file
+	free(path);
+}
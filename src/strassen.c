@@ -0,0 +1,176 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "mat_tools.h"
+#include "matmult.h"
+#include "strassen.h"
+
+typedef struct StrassenState
+{
+	int cutoff;
+	StrassenLeafMult leaf;
+	size_t mem_used;
+	size_t mem_peak;
+} StrassenState;
+
+// z = x + y
+static void mat_add(int m, int n, const float *x, int ldx, const float *y, int ldy, float *z, int ldz)
+{
+	for (int i = 0; i < m; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+		}
+	}
+}
+
+// z = x - y
+static void mat_sub(int m, int n, const float *x, int ldx, const float *y, int ldy, float *z, int ldz)
+{
+	for (int i = 0; i < m; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+		}
+	}
+}
+
+static void mat_zero(int m, int n, float *z, int ldz)
+{
+	for (int i = 0; i < m; i++)
+	{
+		memset(z + i * ldz, 0, n * sizeof(float));
+	}
+}
+
+static float *alloc_temp(StrassenState *state, size_t count)
+{
+	float *mem = (float *)aligned_malloc(count * sizeof(float));
+	if (mem == NULL)
+	{
+		printf("Could not allocate strassen temporary of %zu bytes\n", count * sizeof(float));
+		exit(1);
+	}
+	state->mem_used += count * sizeof(float);
+	if (state->mem_used > state->mem_peak)
+		state->mem_peak = state->mem_used;
+	return mem;
+}
+
+static void free_temp(StrassenState *state, float *mem, size_t count)
+{
+	aligned_free(mem);
+	state->mem_used -= count * sizeof(float);
+}
+
+void strassen_host_leaf(int M, int K, int N, float *a, int lda, float *b, int ldb, float *c, int ldc)
+{
+	mat_zero(M, N, c, ldc);
+	multBlockedStrided(M, K, N, a, lda, b, ldb, c, ldc);
+}
+
+static void winograd(StrassenState *state, int m, int k, int n,
+					 float *a, int lda, float *b, int ldb, float *c, int ldc)
+{
+	if (m <= state->cutoff || k <= state->cutoff || n <= state->cutoff)
+	{
+		state->leaf(m, k, n, a, lda, b, ldb, c, ldc);
+		return;
+	}
+
+	// quadrants of the even part, odd rows/cols are peeled off below
+	int m2 = m / 2, k2 = k / 2, n2 = n / 2;
+	float *a11 = a, *a12 = a + k2, *a21 = a + m2 * lda, *a22 = a21 + k2;
+	float *b11 = b, *b12 = b + n2, *b21 = b + k2 * ldb, *b22 = b21 + n2;
+	float *c11 = c, *c12 = c + n2, *c21 = c + m2 * ldc, *c22 = c21 + n2;
+
+	// temporaries: x for sums of a, y for sums of b, p for the first product
+	// the quadrants of c hold the other products until they are combined
+	float *x = alloc_temp(state, (size_t)m2 * k2);
+	float *y = alloc_temp(state, (size_t)k2 * n2);
+	float *p = alloc_temp(state, (size_t)m2 * n2);
+
+	mat_sub(m2, k2, a11, lda, a21, lda, x, k2);				  // S3 = A11 - A21
+	mat_sub(k2, n2, b22, ldb, b12, ldb, y, n2);				  // T3 = B22 - B12
+	winograd(state, m2, k2, n2, x, k2, y, n2, c21, ldc);	  // M7 = S3 T3
+	mat_add(m2, k2, a21, lda, a22, lda, x, k2);				  // S1 = A21 + A22
+	mat_sub(k2, n2, b12, ldb, b11, ldb, y, n2);				  // T1 = B12 - B11
+	winograd(state, m2, k2, n2, x, k2, y, n2, c22, ldc);	  // M5 = S1 T1
+	mat_sub(m2, k2, x, k2, a11, lda, x, k2);				  // S2 = S1 - A11
+	mat_sub(k2, n2, b22, ldb, y, n2, y, n2);				  // T2 = B22 - T1
+	winograd(state, m2, k2, n2, x, k2, y, n2, c12, ldc);	  // M6 = S2 T2
+	mat_sub(m2, k2, a12, lda, x, k2, x, k2);				  // S4 = A12 - S2
+	winograd(state, m2, k2, n2, x, k2, b22, ldb, c11, ldc);	  // M3 = S4 B22
+	winograd(state, m2, k2, n2, a11, lda, b11, ldb, p, n2);	  // M1 = A11 B11
+	mat_add(m2, n2, p, n2, c12, ldc, c12, ldc);				  // U2 = M1 + M6
+	mat_add(m2, n2, c12, ldc, c21, ldc, c21, ldc);			  // U3 = U2 + M7
+	mat_add(m2, n2, c12, ldc, c22, ldc, c12, ldc);			  // U4 = U2 + M5
+	mat_add(m2, n2, c21, ldc, c22, ldc, c22, ldc);			  // C22 = U3 + M5
+	mat_add(m2, n2, c12, ldc, c11, ldc, c12, ldc);			  // C12 = U4 + M3
+	mat_sub(k2, n2, y, n2, b21, ldb, y, n2);				  // T4 = T2 - B21
+	winograd(state, m2, k2, n2, a22, lda, y, n2, c11, ldc);	  // M4 = A22 T4
+	mat_sub(m2, n2, c21, ldc, c11, ldc, c21, ldc);			  // C21 = U3 - M4
+	winograd(state, m2, k2, n2, a12, lda, b21, ldb, c11, ldc); // M2 = A12 B21
+	mat_add(m2, n2, p, n2, c11, ldc, c11, ldc);				  // C11 = M1 + M2
+
+	free_temp(state, p, (size_t)m2 * n2);
+	free_temp(state, y, (size_t)k2 * n2);
+	free_temp(state, x, (size_t)m2 * k2);
+
+	// dynamic peeling of the odd row/col of each dim
+	if (k % 2)
+	{
+		// rank 1 update with the last col of a and the last row of b
+		multBlockedStrided(2 * m2, 1, 2 * n2, a + k - 1, lda, b + (k - 1) * ldb, ldb, c, ldc);
+	}
+	if (n % 2)
+	{
+		// last col of c
+		mat_zero(m, 1, c + n - 1, ldc);
+		multBlockedStrided(m, k, 1, a, lda, b + n - 1, ldb, c + n - 1, ldc);
+	}
+	if (m % 2)
+	{
+		// last row of c, the last element is done with the last col
+		mat_zero(1, 2 * n2, c + (m - 1) * ldc, ldc);
+		multBlockedStrided(1, k, 2 * n2, a + (m - 1) * lda, lda, b, ldb, c + (m - 1) * ldc, ldc);
+	}
+}
+
+size_t multStrassen(int M, int K, int N, float *a, float *b, float *c, int cutoff, StrassenLeafMult leaf)
+{
+	StrassenState state;
+	state.cutoff = cutoff > 1 ? cutoff : 1;
+	state.leaf = leaf ? leaf : strassen_host_leaf;
+	state.mem_used = 0;
+	state.mem_peak = 0;
+	winograd(&state, M, K, N, a, K, b, N, c, N);
+	return state.mem_peak;
+}
@@ -0,0 +1,322 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// needed for sched_setaffinity
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+#include "thread_pool.h"
+
+// tasks of a run are handed out as one contiguous range per worker
+// the owner takes tasks from the head of its range and thieves take them from the tail
+// so neighbouring tasks (ie: tiles sharing panels) tend to stay on the same thread
+typedef struct WorkerDeque
+{
+	pthread_mutex_t lock;
+	unsigned long generation; // run of the tasks in the range
+	int head;
+	int tail;
+} WorkerDeque;
+
+typedef struct ThreadPool
+{
+	int num_threads;
+	bool pin_threads;
+	pthread_t *threads; // worker 0 is the thread calling thread_pool_run
+	WorkerDeque *deques;
+	pthread_mutex_t run_lock; // one run at a time
+	pthread_mutex_t lock;
+	pthread_cond_t work_ready;
+	pthread_cond_t work_done;
+	unsigned long generation;
+	int pending; // tasks of the current run not finished yet
+	bool stop;
+	ThreadPoolTask task;
+	void *ctx;
+} ThreadPool;
+
+static ThreadPool pool;
+static atomic_bool pool_ready = false;
+// guards the lazy init of the pool by the first run
+static pthread_mutex_t pool_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local int current_worker = 0;
+static _Thread_local bool in_pool_task = false;
+
+int get_num_cores()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+static void pin_thread(int core)
+{
+#if defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		printf("Could not pin thread to core: %d\n", core);
+#endif
+}
+
+// tasks are only taken for the run the worker woke up for, a worker still stealing
+// after the end of the previous run must not take the tasks of the next one
+static bool pop_task(int worker, unsigned long generation, int *task)
+{
+	WorkerDeque *deque = &pool.deques[worker];
+	bool found = false;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->generation == generation && deque->head < deque->tail)
+	{
+		*task = deque->head++;
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static bool steal_task(int worker, unsigned long generation, int *task)
+{
+	for (int i = 1; i < pool.num_threads; i++)
+	{
+		WorkerDeque *deque = &pool.deques[(worker + i) % pool.num_threads];
+		bool found = false;
+		pthread_mutex_lock(&deque->lock);
+		if (deque->generation == generation && deque->head < deque->tail)
+		{
+			*task = --deque->tail;
+			found = true;
+		}
+		pthread_mutex_unlock(&deque->lock);
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+// run tasks of the run generation until all deques are empty, no tasks are added while a run is in progress
+static void work(int worker, unsigned long generation)
+{
+	int task;
+	while (pop_task(worker, generation, &task) || steal_task(worker, generation, &task))
+	{
+		in_pool_task = true;
+		pool.task(pool.ctx, task, worker);
+		in_pool_task = false;
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.pending == 0)
+			pthread_cond_broadcast(&pool.work_done);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	int worker = (int)(intptr_t)arg;
+	current_worker = worker;
+	if (pool.pin_threads)
+		pin_thread(worker % get_num_cores());
+
+	unsigned long seen = 0;
+	pthread_mutex_lock(&pool.lock);
+	while (true)
+	{
+		while (!pool.stop && pool.generation == seen)
+			pthread_cond_wait(&pool.work_ready, &pool.lock);
+		if (pool.stop)
+			break;
+		seen = pool.generation;
+		pthread_mutex_unlock(&pool.lock);
+		work(worker, seen);
+		pthread_mutex_lock(&pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+static void close_pool()
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = true;
+	pthread_cond_broadcast(&pool.work_ready);
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 1; i < pool.num_threads; i++)
+	{
+		pthread_join(pool.threads[i], NULL);
+	}
+	for (int i = 0; i < pool.num_threads; i++)
+	{
+		pthread_mutex_destroy(&pool.deques[i].lock);
+	}
+	pthread_cond_destroy(&pool.work_ready);
+	pthread_cond_destroy(&pool.work_done);
+	pthread_mutex_destroy(&pool.lock);
+	pthread_mutex_destroy(&pool.run_lock);
+	free(pool.threads);
+	free(pool.deques);
+	atomic_store(&pool_ready, false);
+}
+
+// called with pool_init_lock held
+static void create_pool(int num_threads, bool pin_threads)
+{
+	if (atomic_load(&pool_ready))
+		close_pool();
+
+	if (num_threads <= 0)
+		num_threads = get_num_cores();
+	pool.num_threads = num_threads;
+	pool.pin_threads = pin_threads;
+	pool.generation = 0;
+	pool.pending = 0;
+	pool.stop = false;
+	pool.task = NULL;
+	pool.ctx = NULL;
+	pool.threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+	pool.deques = (WorkerDeque *)malloc(num_threads * sizeof(WorkerDeque));
+	pthread_mutex_init(&pool.run_lock, NULL);
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.work_ready, NULL);
+	pthread_cond_init(&pool.work_done, NULL);
+	for (int i = 0; i < num_threads; i++)
+	{
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		pool.deques[i].generation = 0;
+		pool.deques[i].head = 0;
+		pool.deques[i].tail = 0;
+	}
+	for (int i = 1; i < num_threads; i++)
+	{
+		if (pthread_create(&pool.threads[i], NULL, worker_main, (void *)(intptr_t)i) != 0)
+		{
+			printf("Could not create pool thread: %d\n", i);
+			exit(1);
+		}
+	}
+	atomic_store(&pool_ready, true);
+	printf("thread pool threads: %d, pinned: %d\n", num_threads, pin_threads);
+}
+
+void thread_pool_init(int num_threads, bool pin_threads)
+{
+	pthread_mutex_lock(&pool_init_lock);
+	create_pool(num_threads, pin_threads);
+	pthread_mutex_unlock(&pool_init_lock);
+}
+
+void thread_pool_close()
+{
+	pthread_mutex_lock(&pool_init_lock);
+	if (atomic_load(&pool_ready))
+		close_pool();
+	pthread_mutex_unlock(&pool_init_lock);
+}
+
+// creates the pool with the defaults on first use, the flag is checked again under the lock
+// so concurrent first runs create it once
+static void ensure_pool()
+{
+	if (atomic_load(&pool_ready))
+		return;
+	pthread_mutex_lock(&pool_init_lock);
+	if (!atomic_load(&pool_ready))
+		create_pool(0, false);
+	pthread_mutex_unlock(&pool_init_lock);
+}
+
+int thread_pool_size()
+{
+	ensure_pool();
+	return pool.num_threads;
+}
+
+void thread_pool_run(int num_tasks, ThreadPoolTask task, void *ctx)
+{
+	ensure_pool();
+
+	// nothing to share or called from a task, run on the current thread
+	if (num_tasks <= 1 || pool.num_threads == 1 || in_pool_task)
+	{
+		for (int i = 0; i < num_tasks; i++)
+		{
+			task(ctx, i, current_worker);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool.run_lock);
+	// the run state is set before the tasks are published, the workers only see the new generation
+	// once the deques are filled, workers of the previous run skip the tasks of this one
+	pthread_mutex_lock(&pool.lock);
+	unsigned long generation = pool.generation + 1;
+	pool.pending = num_tasks;
+	pool.task = task;
+	pool.ctx = ctx;
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 0; i < pool.num_threads; i++)
+	{
+		WorkerDeque *deque = &pool.deques[i];
+		pthread_mutex_lock(&deque->lock);
+		deque->generation = generation;
+		deque->head = (int)((long long)num_tasks * i / pool.num_threads);
+		deque->tail = (int)((long long)num_tasks * (i + 1) / pool.num_threads);
+		pthread_mutex_unlock(&deque->lock);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.generation = generation;
+	pthread_cond_broadcast(&pool.work_ready);
+	pthread_mutex_unlock(&pool.lock);
+
+	// the calling thread is worker 0
+	work(0, generation);
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.pending > 0)
+		pthread_cond_wait(&pool.work_done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+	pthread_mutex_unlock(&pool.run_lock);
+}
@@ -0,0 +1,240 @@
+/*
+MIT License
+
+Copyright (c) 2024 Max Kas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tuning_db.h"
+#include "opencl_tools.h"
+
+#define TUNING_LINE_SIZE 1024
+// smallest bucket, smaller dims share it
+#define TUNING_MIN_BUCKET 16
+
+typedef struct TuningEntry
+{
+	char *device_name;
+	char *kernel_name;
+	MatMultDims bucket;
+	TileParams tile_params;
+	double gflops;
+	struct TuningEntry *next;
+} TuningEntry;
+
+static TuningEntry *entries = NULL;
+static pthread_mutex_t db_lock;
+static pthread_once_t db_once = PTHREAD_ONCE_INIT;
+static char *db_file = NULL;
+static bool db_loaded = false;
+
+static void db_init()
+{
+	pthread_mutex_init(&db_lock, NULL);
+	db_file = get_cache_path("MATMUL_TUNING_FILE", "tuning.txt");
+}
+
+static int get_bucket_dim(int dim)
+{
+	int bucket = TUNING_MIN_BUCKET;
+	while (bucket < dim)
+		bucket *= 2;
+	return bucket;
+}
+
+static MatMultDims get_bucket(MatMultDims dims)
+{
+	MatMultDims bucket;
+	bucket.m = get_bucket_dim(dims.m);
+	bucket.k = get_bucket_dim(dims.k);
+	bucket.n = get_bucket_dim(dims.n);
+	return bucket;
+}
+
+static TuningEntry *find_entry(const char *device_name, const char *kernel_name, MatMultDims bucket)
+{
+	for (TuningEntry *entry = entries; entry != NULL; entry = entry->next)
+	{
+		if (entry->bucket.m == bucket.m && entry->bucket.k == bucket.k && entry->bucket.n == bucket.n &&
+			strcmp(entry->kernel_name, kernel_name) == 0 && strcmp(entry->device_name, device_name) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static void set_entry(const char *device_name, const char *kernel_name, MatMultDims bucket,
+					  TileParams tile_params, double gflops)
+{
+	TuningEntry *entry = find_entry(device_name, kernel_name, bucket);
+	if (entry == NULL)
+	{
+		entry = (TuningEntry *)malloc(sizeof(TuningEntry));
+		entry->device_name = copy_str(device_name);
+		entry->kernel_name = copy_str(kernel_name);
+		entry->bucket = bucket;
+		entry->next = entries;
+		entries = entry;
+	}
+	entry->tile_params = tile_params;
+	entry->gflops = gflops;
+}
+
+static void free_entries()
+{
+	while (entries != NULL)
+	{
+		TuningEntry *next = entries->next;
+		free(entries->device_name);
+		free(entries->kernel_name);
+		free(entries);
+		entries = next;
+	}
+}
+
+// one entry per line: device \t kernel \t m k n \t BM BN BK WIM WIN VEC DBUF LPAD \t gflops
+// VEC, DBUF and LPAD can be missing in files of older versions, they used scalar loads,
+// single buffers and unpadded local tiles
+static void load_db()
+{
+	db_loaded = true;
+	if (db_file == NULL)
+		return;
+	FILE *file = fopen(db_file, "r");
+	if (file == NULL)
+		return;
+	char line[TUNING_LINE_SIZE];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		char *device_name = strtok(line, "\t");
+		char *kernel_name = strtok(NULL, "\t");
+		char *bucket_str = strtok(NULL, "\t");
+		char *params_str = strtok(NULL, "\t");
+		char *gflops_str = strtok(NULL, "\t\n");
+		MatMultDims bucket;
+		TileParams tile_params;
+		tile_params.VEC = 1;
+		tile_params.DBUF = 0;
+		tile_params.LPAD = 0;
+		if (gflops_str == NULL ||
+			sscanf(bucket_str, "%d %d %d", &bucket.m, &bucket.k, &bucket.n) != 3 ||
+			sscanf(params_str, "%d %d %d %d %d %d %d %d", &tile_params.BM, &tile_params.BN, &tile_params.BK,
+				   &tile_params.WIM, &tile_params.WIN, &tile_params.VEC, &tile_params.DBUF,
+				   &tile_params.LPAD) < 5)
+		{
+			printf("skipping invalid tuning db line in %s\n", db_file);
+			continue;
+		}
+		set_entry(device_name, kernel_name, bucket, tile_params, atof(gflops_str));
+	}
+	fclose(file);
+}
+
+// written to a temp file first so a concurrent load never sees a partial file
+static void save_db()
+{
+	if (db_file == NULL)
+		return;
+	make_dirs(db_file);
+	char *tmp_path = (char *)malloc(strlen(db_file) + 8);
+	sprintf(tmp_path, "%s.tmp", db_file);
+	FILE *file = fopen(tmp_path, "w");
+	if (file == NULL)
+	{
+		printf("Could not write tuning db: %s\n", tmp_path);
+		free(tmp_path);
+		return;
+	}
+	fprintf(file, "# matmul tuning db: device\tkernel\tbucket m k n\tBM BN BK WIM WIN VEC DBUF LPAD\tgflops\n");
+	for (TuningEntry *entry = entries; entry != NULL; entry = entry->next)
+	{
+		fprintf(file, "%s\t%s\t%d %d %d\t%d %d %d %d %d %d %d %d\t%.2lf\n",
+				entry->device_name, entry->kernel_name,
+				entry->bucket.m, entry->bucket.k, entry->bucket.n,
+				entry->tile_params.BM, entry->tile_params.BN, entry->tile_params.BK,
+				entry->tile_params.WIM, entry->tile_params.WIN, entry->tile_params.VEC,
+				entry->tile_params.DBUF, entry->tile_params.LPAD, entry->gflops);
+	}
+	bool written = fclose(file) == 0;
+	if (written)
+	{
+		// rename does not replace existing files on windows
+		remove(db_file);
+		written = rename(tmp_path, db_file) == 0;
+	}
+	if (!written)
+	{
+		printf("Could not save tuning db: %s\n", db_file);
+		remove(tmp_path);
+	}
+	free(tmp_path);
+}
+
+bool tuning_db_lookup(const char *device_name, const char *kernel_name, MatMultDims dims, TileParams *tile_params)
+{
+	pthread_once(&db_once, db_init);
+	pthread_mutex_lock(&db_lock);
+	if (!db_loaded)
+		load_db();
+	TuningEntry *entry = find_entry(device_name, kernel_name, get_bucket(dims));
+	if (entry != NULL)
+		*tile_params = entry->tile_params;
+	pthread_mutex_unlock(&db_lock);
+	return entry != NULL;
+}
+
+void tuning_db_store(const char *device_name, const char *kernel_name, MatMultDims dims,
+					 TileParams tile_params, double gflops)
+{
+	pthread_once(&db_once, db_init);
+	pthread_mutex_lock(&db_lock);
+	if (!db_loaded)
+		load_db();
+	set_entry(device_name, kernel_name, get_bucket(dims), tile_params, gflops);
+	save_db();
+	pthread_mutex_unlock(&db_lock);
+}
+
+void tuning_db_set_file(const char *path)
+{
+	pthread_once(&db_once, db_init);
+	pthread_mutex_lock(&db_lock);
+	free(db_file);
+	db_file = path != NULL ? copy_str(path) : NULL;
+	// entries of the previous file are dropped, the new file is loaded on the next use
+	free_entries();
+	db_loaded = false;
+	pthread_mutex_unlock(&db_lock);
+}
+
+void tuning_db_close()
+{
+	pthread_once(&db_once, db_init);
+	pthread_mutex_lock(&db_lock);
+	free_entries();
+	db_loaded = false;
+	pthread_mutex_unlock(&db_lock);
+}
@@ -35,12 +35,15 @@ SOFTWARE.
 
 #include "opencl_matmult.h"
 #include "opencl_tools.h"
+#include "buffer_pool.h"
+#include "matmul_alloc.h"
 
 #define INFO 1
 #define DEBUG true
 
 void testTrials();
 void printUsage(char *exename);
+void benchLocalPadding(MatMultDims dims);
 
 const enum GenType GEN_TYPE = GEN_INCR;
 
@@ -62,6 +65,58 @@ bool validate_results = false;
 bool use_simple_matmult = false;
 // bool use_simple_matmult = true;
 
+bool use_host_blocked_matmult = false;
+// bool use_host_blocked_matmult = true;
+
+bool use_strassen_matmult = false;
+// bool use_strassen_matmult = true;
+
+bool use_streaming_matmult = false;
+// bool use_streaming_matmult = true;
+
+// rows split over the devices, set use_multi_device or use_sub_devices in the library to use more than one
+bool use_multi_device_matmult = false;
+// bool use_multi_device_matmult = true;
+
+// a and b uploaded once as device handles, the result stays on the device until downloaded
+bool use_handle_matmult = false;
+// bool use_handle_matmult = true;
+
+// a packed once as a fixed operand, mults with it skip the transpose and padding
+bool use_packed_matmult = false;
+// bool use_packed_matmult = true;
+
+// a, b and c stored as DTYPE (half or bfloat16) with float accumulation, the values should fit the dtype range
+bool use_dtype_matmult = false;
+// bool use_dtype_matmult = true;
+const int DTYPE = MatFloat16;
+// const int DTYPE = MatBFloat16;
+
+// a and b quantized to int8 with zero points, int32 accumulation validated against the float mult of the dequantized values
+bool use_int8_matmult = false;
+// bool use_int8_matmult = true;
+
+// mult type picked by the cost model, calibrated on the first call
+bool use_auto_matmult = false;
+// bool use_auto_matmult = true;
+
+bool use_sgemm = false;
+// bool use_sgemm = true;
+
+bool use_batched_matmult = false;
+// bool use_batched_matmult = true;
+const int BATCH = 4;
+
+bool use_grouped_matmult = false;
+// bool use_grouped_matmult = true;
+
+bool use_async_matmult = false;
+// bool use_async_matmult = true;
+
+// allocate the matrices with matmul_alloc so the kernels can use them without copies (needs use_zero_copy)
+bool use_matmul_alloc = false;
+// bool use_matmul_alloc = true;
+
 bool print_mat = false;
 bool enable_log = false;
 
@@ -78,6 +133,24 @@ int main(int argc, char *argv[])
 		displayPlatforms();
 		return 0;
 	}
+	else if (argc == 5 && strcmp(argv[1], "--tune") == 0)
+	{
+		MatMultDims dims = {atoi(argv[2]), atoi(argv[3]), atoi(argv[4])};
+		init_opencl();
+		openclTuneTiling(MatMultTiling, dims);
+		openclTuneTiling(MatMultTilingColMaj, dims);
+		openclTuneTiling(MatMultTilingColMajPadded, dims);
+		close_opencl();
+		return 0;
+	}
+	else if (argc == 5 && strcmp(argv[1], "--bench-lpad") == 0)
+	{
+		MatMultDims dims = {atoi(argv[2]), atoi(argv[3]), atoi(argv[4])};
+		init_opencl();
+		benchLocalPadding(dims);
+		close_opencl();
+		return 0;
+	}
 
 	init_opencl();
 	testTrials();
@@ -92,8 +165,8 @@ void run_matmult(MatMultDims dims, float *a, float *b, float *c)
 	{
 		start = time(NULL);
 		printf("\nrunning cpu matmult\n");
-		// simple mat mult using CPU for validating results
-		mult(dims.m, dims.k, dims.n, a, b, c);
+		// cache blocked mat mult using CPU for validating results
+		multBlocked(dims.m, dims.k, dims.n, a, b, c);
 		end = time(NULL);
 		// printf("time for mult (secs): %.3lf\n", (double)(end - start));
 		res_mat = create(dims.m, dims.n, 0);
@@ -119,6 +192,325 @@ void run_matmult(MatMultDims dims, float *a, float *b, float *c)
 		memset(c, 0, sizeof(float) * dims.m * dims.n);
 	}
 
+	// cpu cache blocked mat mult for comparing against the kernels
+	if (use_host_blocked_matmult)
+	{
+		printf("\nrunning host blocked matmult\n");
+		openclMatMult(dims, a, b, c, MatMultHostBlocked);
+		if (print_mat)
+		{
+			print_matrix("host blocked matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	// strassen-winograd with leaves on the padded tiling kernel
+	if (use_strassen_matmult)
+	{
+		printf("\nrunning strassen matmult\n");
+		openclMatMult(dims, a, b, c, MatMultStrassen);
+		if (print_mat)
+		{
+			print_matrix("strassen matmult c", c, dims.m, dims.n);
+		}
+		// note: strassen reorders the additions and its sums cancel, so the error follows the largest entries
+		// of the operands and the small entries of c are off by more than the float rounding (up to ~9%
+		// measured for 4096 with the default leaf size)
+		if (validate_results)
+		{
+			assert_mat_near(dims.m, dims.n, c, res_mat, 1.5e-1f);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	// panels streamed through the device, for matrices larger than the device memory
+	if (use_streaming_matmult)
+	{
+		printf("\nrunning opencl streaming matmult\n");
+		openclMatMult(dims, a, b, c, MatMultStreaming);
+		if (print_mat)
+		{
+			print_matrix("opencl streaming matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	if (use_multi_device_matmult)
+	{
+		printf("\nrunning opencl multi device matmult\n");
+		openclMatMult(dims, a, b, c, MatMultMultiDevice);
+		if (print_mat)
+		{
+			print_matrix("opencl multi device matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	if (use_auto_matmult)
+	{
+		printf("\nrunning auto matmult\n");
+		openclMatMult(dims, a, b, c, MatMultAuto);
+		if (print_mat)
+		{
+			print_matrix("auto matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	if (use_handle_matmult)
+	{
+		printf("\nrunning opencl handle matmult\n");
+		MatHandle *ha = matHandleUpload(dims.m, dims.k, a);
+		MatHandle *hb = matHandleUpload(dims.k, dims.n, b);
+		MatHandle *hc = openclMatMultHandle(ha, hb, MatMultTilingColMajPadded);
+		matHandleDownload(hc, c);
+		if (print_mat)
+		{
+			print_matrix("opencl handle matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+		matHandleRelease(hc);
+		matHandleRelease(hb);
+		matHandleRelease(ha);
+	}
+
+	if (use_packed_matmult)
+	{
+		printf("\nrunning opencl packed matmult\n");
+		MatHandle *pa = matHandlePack(dims.m, dims.k, a, MatOperandA, MatMultTilingColMajPadded);
+		openclMatMultPackedA(pa, dims.n, b, c, MatMultTilingColMajPadded);
+		if (print_mat)
+		{
+			print_matrix("opencl packed matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+		matHandleRelease(pa);
+	}
+
+	if (use_dtype_matmult)
+	{
+		printf("\nrunning opencl dtype matmult\n");
+		size_t elem_size = dtype_size(DTYPE);
+		void *ad = malloc((size_t)dims.m * dims.k * elem_size);
+		void *bd = malloc((size_t)dims.k * dims.n * elem_size);
+		void *cd = malloc((size_t)dims.m * dims.n * elem_size);
+		convert_to_dtype(a, ad, (size_t)dims.m * dims.k, DTYPE);
+		convert_to_dtype(b, bd, (size_t)dims.k * dims.n, DTYPE);
+		openclMatMultDType(dims, ad, bd, cd, MatMultTilingColMajPadded, DTYPE);
+		convert_from_dtype(cd, c, (size_t)dims.m * dims.n, DTYPE);
+		if (print_mat)
+		{
+			print_matrix("opencl dtype matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_near(dims.m, dims.n, c, res_mat, DTYPE == MatBFloat16 ? 2e-2f : 4e-3f);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+		free(ad);
+		free(bd);
+		free(cd);
+	}
+
+	if (use_int8_matmult)
+	{
+		printf("\nrunning opencl int8 matmult\n");
+		MatQuantParams params = {1, -2, NULL, NULL, 1.0f, 0};
+		int8_t *aq = malloc((size_t)dims.m * dims.k);
+		int8_t *bq = malloc((size_t)dims.k * dims.n);
+		int8_t *cq = malloc((size_t)dims.m * dims.n);
+		int *ci = malloc((size_t)dims.m * dims.n * sizeof(int));
+		float *a_scales = malloc(dims.m * sizeof(float));
+		float *b_scales = malloc(dims.n * sizeof(float));
+		float *ad = create(dims.m, dims.k, 0);
+		float *bd = create(dims.k, dims.n, 0);
+		float *res_q = create(dims.m, dims.n, 0);
+		float *res_s = create(dims.m, dims.n, 0);
+		for (size_t i = 0; i < (size_t)dims.m * dims.k; i++)
+		{
+			aq[i] = (int8_t)(i % 7 - 2);
+			ad[i] = aq[i] - params.a_zero;
+		}
+		for (size_t i = 0; i < (size_t)dims.k * dims.n; i++)
+		{
+			bq[i] = (int8_t)(i % 5 - 2);
+			bd[i] = bq[i] - params.b_zero;
+		}
+		// multiples of powers of two so the scaled values are exact
+		for (int i = 0; i < dims.m; i++)
+			a_scales[i] = (i % 7 + 1) * 0.125f;
+		for (int i = 0; i < dims.n; i++)
+			b_scales[i] = (i % 4 + 1) * 0.25f;
+		if (validate_results)
+			multBlocked(dims.m, dims.k, dims.n, ad, bd, res_q);
+
+		// int32 accumulator
+		openclMatMultInt8(dims, aq, bq, ci, &params, MatQuantInt32);
+		if (validate_results)
+		{
+			for (size_t i = 0; i < (size_t)dims.m * dims.n; i++)
+				c[i] = (float)ci[i];
+			assert_mat_equal(dims.m, dims.n, c, res_q);
+		}
+
+		// float scaled by the row scales of a and the column scales of b
+		params.a_scales = a_scales;
+		params.b_scales = b_scales;
+		openclMatMultInt8(dims, aq, bq, c, &params, MatQuantFloat);
+		if (print_mat)
+		{
+			print_matrix("opencl int8 matmult c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			for (int i = 0; i < dims.m; i++)
+				for (int j = 0; j < dims.n; j++)
+					res_s[i * dims.n + j] = res_q[i * dims.n + j] * a_scales[i] * b_scales[j];
+			assert_mat_equal(dims.m, dims.n, c, res_s);
+		}
+
+		// int8 requantized, val / c_scale is exact and has halves that round to even, the larger values saturate
+		params.c_scale = 0.0625f;
+		params.c_zero = 3;
+		openclMatMultInt8(dims, aq, bq, cq, &params, MatQuantInt8);
+		if (validate_results)
+		{
+			int saturated_low = 0, saturated_high = 0;
+			for (size_t i = 0; i < (size_t)dims.m * dims.n; i++)
+			{
+				int q = (int)rintf(res_s[i] / params.c_scale) + params.c_zero;
+				q = q < -128 ? -128 : (q > 127 ? 127 : q);
+				saturated_low += q == -128;
+				saturated_high += q == 127;
+				res_s[i] = (float)q;
+				c[i] = (float)cq[i];
+			}
+			printf("int8 requantized values saturated at -128: %d, at 127: %d\n", saturated_low, saturated_high);
+			assert_mat_equal(dims.m, dims.n, c, res_s);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+		free(aq);
+		free(bq);
+		free(cq);
+		free(ci);
+		free(a_scales);
+		free(b_scales);
+		free(ad);
+		free(bd);
+		free(res_q);
+		free(res_s);
+	}
+
+	// blas style sgemm, c = 1.0 * a * b + 0.0 * c
+	if (use_sgemm)
+	{
+		printf("\nrunning opencl sgemm\n");
+		sgemm(MatRowMajor, MatNoTrans, MatNoTrans, dims.m, dims.n, dims.k,
+			  1.0f, a, dims.k, b, dims.n, 0.0f, c, dims.n);
+		if (print_mat)
+		{
+			print_matrix("opencl sgemm c", c, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+		}
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
+	// strided batch of the same a and b (stride 0) in a single launch
+	if (use_batched_matmult)
+	{
+		printf("\nrunning opencl strided batched matmult, batch: %d\n", BATCH);
+		float *cb = (float *)malloc(sizeof(float) * BATCH * dims.m * dims.n);
+		openclMatMultStridedBatched(dims, BATCH, a, 0, b, 0, cb, (long)dims.m * dims.n);
+		if (print_mat)
+		{
+			print_matrix("opencl strided batched matmult c", cb, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			for (int i = 0; i < BATCH; i++)
+				assert_mat_equal(dims.m, dims.n, cb + (size_t)i * dims.m * dims.n, res_mat);
+		}
+		free(cb);
+	}
+
+	// grouped with different dims: the full mult and the top half of it (first rows of a)
+	if (use_grouped_matmult)
+	{
+		printf("\nrunning opencl grouped matmult\n");
+		MatMultDims group_dims[2] = {dims, {dims.m / 2, dims.k, dims.n}};
+		size_t offsetsA[2] = {0, 0};
+		size_t offsetsB[2] = {0, 0};
+		size_t offsetsC[2] = {0, (size_t)dims.m * dims.n};
+		float *cg = (float *)malloc(sizeof(float) * (dims.m * dims.n + (dims.m / 2) * dims.n));
+		openclMatMultGrouped(2, group_dims, a, offsetsA, b, offsetsB, cg, offsetsC);
+		if (print_mat)
+		{
+			print_matrix("opencl grouped matmult c", cg, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, cg, res_mat);
+			assert_mat_equal(dims.m / 2, dims.n, cg + offsetsC[1], res_mat);
+		}
+		free(cg);
+	}
+
+	// two async mults, the second one chained after the first
+	if (use_async_matmult)
+	{
+		printf("\nrunning opencl async matmult\n");
+		float *c2 = create(dims.m, dims.n, 0);
+		MatMultHandle *handle = openclMatMultAsync(dims, a, b, c, MatMultTiling, 0, NULL);
+		cl_event event = openclMatMultGetEvent(handle);
+		MatMultHandle *handle2 = openclMatMultAsync(dims, a, b, c2, MatMultTiling, 1, &event);
+		openclMatMultWait(handle2);
+		if (!openclMatMultTest(handle))
+		{
+			printf("async mult not complete after the chained mult\n");
+			exit(1);
+		}
+		openclMatMultRelease(handle);
+		openclMatMultRelease(handle2);
+		if (print_mat)
+		{
+			print_matrix("opencl async matmult c", c2, dims.m, dims.n);
+		}
+		if (validate_results)
+		{
+			assert_mat_equal(dims.m, dims.n, c, res_mat);
+			assert_mat_equal(dims.m, dims.n, c2, res_mat);
+		}
+		free(c2);
+		memset(c, 0, sizeof(float) * dims.m * dims.n);
+	}
+
 	// opencl no transpose with tiling (fast)
 	printf("\nrunning opencl matmult w/ tiling\n");
 	openclMatMult(dims, a, b, c, MatMultTiling);
@@ -193,9 +585,20 @@ void testTrials()
 
 		printf("\niteration: %d\n", i + 1);
 		printf("dimensions: M: %d, K: %d, N: %d\n", dims.m, dims.k, dims.n);
-		float *a = create(dims.m, dims.k, 0);
-		float *b = create(dims.k, dims.n, 0);
-		float *c = create(dims.m, dims.n, 0);
+		float *a, *b, *c;
+		if (use_matmul_alloc)
+		{
+			a = (float *)matmul_alloc(sizeof(float) * dims.m * dims.k);
+			b = (float *)matmul_alloc(sizeof(float) * dims.k * dims.n);
+			c = (float *)matmul_alloc(sizeof(float) * dims.m * dims.n);
+			memset(c, 0, sizeof(float) * dims.m * dims.n);
+		}
+		else
+		{
+			a = create(dims.m, dims.k, 0);
+			b = create(dims.k, dims.n, 0);
+			c = create(dims.m, dims.n, 0);
+		}
 
 		gen(GEN_TYPE, a, dims.m, dims.k);
 		gen(GEN_TYPE, b, dims.k, dims.n);
@@ -207,15 +610,87 @@ void testTrials()
 
 		run_matmult(dims, a, b, c);
 
-		free(a);
-		free(b);
-		free(c);
+		if (use_matmul_alloc)
+		{
+			matmul_free(a);
+			matmul_free(b);
+			matmul_free(c);
+		}
+		else
+		{
+			free(a);
+			free(b);
+			free(c);
+		}
+	}
+	// device buffers are reused across the trials
+	buffer_pool_print_stats();
+}
+
+// tilings compared with and without the padding of the local tiles
+static const TileParams bench_tilings[] = {
+	{16, 16, 8, 4, 4, 4, 0, 0},
+	{32, 32, 8, 4, 4, 4, 0, 0},
+	{64, 64, 8, 4, 4, 4, 0, 0},
+	{64, 64, 16, 8, 8, 4, 0, 0},
+	{64, 64, 16, 8, 8, 4, 1, 0},
+	{128, 128, 16, 8, 8, 4, 0, 0},
+	{128, 128, 8, 8, 8, 1, 0, 0},
+};
+
+#define BENCH_TYPES 3
+#define BENCH_LPADS 3
+
+void benchLocalPadding(MatMultDims dims)
+{
+	int mult_types[BENCH_TYPES] = {MatMultTiling, MatMultTilingColMaj, MatMultTilingColMajPadded};
+	const char *mult_names[BENCH_TYPES] = {"tiling", "tiling col major", "tiling col major padded"};
+	int lpads[BENCH_LPADS] = {0, 1, 2};
+	int tilings = sizeof(bench_tilings) / sizeof(*bench_tilings);
+
+	// all the tilings of a mult type are timed on the same operands
+	TileParams *tile_params = (TileParams *)malloc(tilings * BENCH_LPADS * sizeof(TileParams));
+	for (int i = 0; i < tilings; i++)
+		for (int l = 0; l < BENCH_LPADS; l++)
+		{
+			tile_params[i * BENCH_LPADS + l] = bench_tilings[i];
+			tile_params[i * BENCH_LPADS + l].LPAD = lpads[l];
+		}
+	// the kernels log while they run, the table is printed at the end
+	double *gflops = (double *)malloc(BENCH_TYPES * tilings * BENCH_LPADS * sizeof(double));
+	for (int t = 0; t < BENCH_TYPES; t++)
+		openclBenchTiling(mult_types[t], dims, tilings * BENCH_LPADS, tile_params, gflops + t * tilings * BENCH_LPADS);
+	free(tile_params);
+
+	printf("GFLOPS for %d, %d, %d by local tile padding (- for tilings the device can not run)\n", dims.m, dims.k, dims.n);
+	for (int t = 0; t < BENCH_TYPES; t++)
+	{
+		printf("%s\n", mult_names[t]);
+		printf("BM BN BK WIM WIN VEC DBUF | LPAD=0 | LPAD=1 | LPAD=2\n");
+		for (int i = 0; i < tilings; i++)
+		{
+			TileParams tile_params = bench_tilings[i];
+			printf("%d %d %d %d %d %d %d", tile_params.BM, tile_params.BN, tile_params.BK,
+				   tile_params.WIM, tile_params.WIN, tile_params.VEC, tile_params.DBUF);
+			for (int l = 0; l < BENCH_LPADS; l++)
+			{
+				double value = gflops[(t * tilings + i) * BENCH_LPADS + l];
+				if (value < 0)
+					printf(" | -");
+				else
+					printf(" | %.2lf", value);
+			}
+			printf("\n");
+		}
 	}
+	free(gflops);
 }
 
 void printUsage(char *exename)
 {
-	printf("%s [--help | --list-gpu]\r\n", exename);
+	printf("%s [--help | --list-gpu | --tune M K N | --bench-lpad M K N]\r\n", exename);
 	printf("--help: show help\r\n");
 	printf("--list-gpu]: display gpu info\r\n");
+	printf("--tune M K N: tune the tiling of the tiled kernels for the dims and store it in the tuning db\r\n");
+	printf("--bench-lpad M K N: compare the GFLOPS of the tiled kernels with and without the padding of the local tiles\r\n");
 }
\ No newline at end of file